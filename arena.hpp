@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for memory that lives until the end of a frame. reset() reclaims everything at
+// once; when the frame before needed more than the arena held, it first trades its blocks for one
+// with headroom over that peak, so a steady workload stops touching the heap after its first frame.
+class FrameArena {
+public:
+    // Every allocation starts on its own cache line, so per-thread arrays never share one
+    static constexpr size_t ALIGNMENT = 64;
+
+    // Space kept beyond the largest frame seen, as a fraction of it
+    static constexpr size_t HEADROOM_DIVISOR = 2;
+
+    // Smallest block taken for a frame that outgrew the arena
+    static constexpr size_t MIN_OVERFLOW_SIZE = 64 * 1024;
+
+private:
+    unsigned char* block = nullptr;
+    size_t blockSize = 0;
+    size_t offset = 0;
+
+    // Taken when the current frame outgrew block, and freed by the next reset()
+    std::vector<unsigned char*> overflowBlocks;
+    unsigned char* overflow = nullptr;
+    size_t overflowSize = 0;
+    size_t overflowOffset = 0;
+
+    size_t frameBytes = 0;
+    size_t peakBytes = 0;
+    unsigned long long growthCount = 0;
+
+public:
+    FrameArena() {
+        this->overflowBlocks.reserve(16);
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    ~FrameArena() {
+        release();
+        freeBlock(this->block);
+    }
+
+    // Uninitialized space for count objects; only types without destructors may live here
+    template <typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "FrameArena only holds trivially destructible types");
+        return static_cast<T*>(allocateBytes(count * sizeof(T)));
+    }
+
+    void* allocateBytes(size_t size) {
+        size = roundUp(std::max<size_t>(size, 1));
+        this->frameBytes += size;
+
+        if (this->offset + size <= this->blockSize) {
+            void* data = this->block + this->offset;
+            this->offset += size;
+            return data;
+        }
+
+        if (this->overflowOffset + size > this->overflowSize) {
+            this->overflowSize = std::max({ size, this->blockSize, 2 * this->overflowSize, MIN_OVERFLOW_SIZE });
+            this->overflow = takeBlock(this->overflowSize);
+            this->overflowBlocks.push_back(this->overflow);
+            this->overflowOffset = 0;
+        }
+        void* data = this->overflow + this->overflowOffset;
+        this->overflowOffset += size;
+        return data;
+    }
+
+    // Invalidates everything allocated since the last reset
+    void reset() {
+        this->peakBytes = std::max(this->peakBytes, this->frameBytes);
+        if (!this->overflowBlocks.empty()) {
+            release();
+            reserve(this->peakBytes + this->peakBytes / HEADROOM_DIVISOR);
+        }
+        this->offset = 0;
+        this->frameBytes = 0;
+    }
+
+    // Grows the arena to at least bytes now, instead of on the first frame that needs them.
+    // Only valid right after reset(), or before anything was allocated.
+    void reserve(size_t bytes) {
+        bytes = roundUp(bytes);
+        if (bytes <= this->blockSize) {
+            return;
+        }
+        freeBlock(this->block);
+        this->block = takeBlock(bytes);
+        this->blockSize = bytes;
+        this->offset = 0;
+        this->growthCount++;
+    }
+
+    size_t capacity() const {
+        return this->blockSize;
+    }
+
+    // Bytes allocated since the last reset, alignment included
+    size_t used() const {
+        return this->frameBytes;
+    }
+
+    // Most bytes any finished frame allocated
+    size_t peak() const {
+        return this->peakBytes;
+    }
+
+    // Times the arena was replaced by a larger one
+    unsigned long long growths() const {
+        return this->growthCount;
+    }
+
+private:
+    static size_t roundUp(size_t size) {
+        return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    static unsigned char* takeBlock(size_t size) {
+        return static_cast<unsigned char*>(::operator new(size, std::align_val_t(ALIGNMENT)));
+    }
+
+    static void freeBlock(unsigned char* data) {
+        if (data != nullptr) {
+            ::operator delete(data, std::align_val_t(ALIGNMENT));
+        }
+    }
+
+    void release() {
+        for (unsigned char* data : this->overflowBlocks) {
+            freeBlock(data);
+        }
+        this->overflowBlocks.clear();
+        this->overflow = nullptr;
+        this->overflowSize = 0;
+        this->overflowOffset = 0;
+    }
+};
+
+// Growable array whose storage comes from a FrameArena. Outgrowing it moves the items to a larger
+// allocation from the same arena; the old space is reclaimed with the rest on the next reset().
+template <typename T>
+class ArenaArray {
+    static_assert(std::is_trivially_copyable<T>::value, "ArenaArray items are moved with memcpy");
+
+private:
+    FrameArena* arena = nullptr;
+    T* items = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+
+public:
+    // Starts an empty array with room for capacity items; call again after every arena reset()
+    void start(FrameArena& arena, size_t capacity) {
+        this->arena = &arena;
+        this->capacity = std::max<size_t>(capacity, 16);
+        this->items = arena.allocate<T>(this->capacity);
+        this->count = 0;
+    }
+
+    void push_back(const T& item) {
+        if (this->count == this->capacity) {
+            T* moved = this->arena->template allocate<T>(2 * this->capacity);
+            std::memcpy(moved, this->items, this->count * sizeof(T));
+            this->items = moved;
+            this->capacity *= 2;
+        }
+        this->items[this->count++] = item;
+    }
+
+    T& operator[](size_t i) {
+        return this->items[i];
+    }
+
+    const T& operator[](size_t i) const {
+        return this->items[i];
+    }
+
+    size_t size() const {
+        return this->count;
+    }
+
+    bool empty() const {
+        return this->count == 0;
+    }
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "presenter.hpp"
+
+// Presents frames on a dedicated thread so slow terminal writes never stall rasterization.
+// Finished frames are copied into a ring of SLOT_COUNT slots shared by exactly one producer (the
+// render loop) and one consumer (the presenter thread). The handoff is two atomic indices. Each side
+// notifies the other with wakeMutex held, so a thread checking an index under the mutex before it
+// sleeps cannot miss a notification: an idle presenter thread and flush() sleep until woken.
+class AsyncPresenter {
+public:
+    static constexpr unsigned int SLOT_COUNT = 3;
+
+private:
+    size_t frameSize;
+    unsigned int height;
+    std::vector<char> slots;
+
+    // Colors of each slot, sized on the first frame submitted with colors
+    std::vector<uint32_t> colorSlots;
+
+    // Row range handed to TerminalPresenter::compose() for each slot, and whether it has colors
+    unsigned int slotRowBegin[SLOT_COUNT] = {};
+    unsigned int slotRowEnd[SLOT_COUNT] = {};
+    bool slotHasColors[SLOT_COUNT] = {};
+
+    // Free-running counters: slot i % SLOT_COUNT is full when readIndex <= i < writeIndex
+    std::atomic<unsigned long long> writeIndex{0};
+    std::atomic<unsigned long long> readIndex{0};
+    std::atomic<unsigned long long> droppedFrames{0};
+
+    // Owned by the presenter thread; settings reach it through the flags below
+    TerminalPresenter presenter;
+    std::ostream& os;
+
+    // Replaces os when set. While it is backed up, queued frames are dropped down to the newest.
+    std::shared_ptr<OutputBackend> output;
+    std::atomic<bool> isDiffEnabled{true};
+    std::atomic<ColorMode> colorMode{ColorMode::Monochrome};
+    std::atomic<bool> isResetRequested{false};
+
+    std::atomic<bool> isRunning{true};
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable drainCondition;
+
+    mutable std::mutex statsMutex;
+    PresentStats stats;
+
+    std::thread thread;
+
+public:
+    AsyncPresenter(unsigned int width, unsigned int height, std::ostream& os = std::cout)
+        : frameSize(width * height), height(height), slots(SLOT_COUNT * width * height), presenter(width, height), os(os) {
+        this->thread = std::thread(&AsyncPresenter::presentLoop, this);
+    }
+
+    AsyncPresenter(unsigned int width, unsigned int height, std::shared_ptr<OutputBackend> output)
+        : frameSize(width * height), height(height), slots(SLOT_COUNT * width * height), presenter(width, height),
+          os(std::cout), output(std::move(output)) {
+        this->thread = std::thread(&AsyncPresenter::presentLoop, this);
+    }
+
+    AsyncPresenter(const AsyncPresenter&) = delete;
+    AsyncPresenter& operator=(const AsyncPresenter&) = delete;
+
+    // Presents every frame still queued, then stops the thread
+    ~AsyncPresenter() {
+        {
+            std::lock_guard<std::mutex> lock(this->wakeMutex);
+            this->isRunning.store(false);
+        }
+        this->wakeCondition.notify_one();
+        this->thread.join();
+    }
+
+    // Queues a copy of the frame. Never blocks: when all slots are still waiting to be presented the
+    // frame is dropped and false is returned.
+    bool submit(const char* frame) {
+        return submit(frame, nullptr, 0, this->height);
+    }
+
+    // As submit(frame), with colors and the rows outside [rowBegin, rowEnd) as for TerminalPresenter::compose()
+    bool submit(const char* frame, const uint32_t* colors, unsigned int rowBegin, unsigned int rowEnd) {
+        unsigned long long write = this->writeIndex.load(std::memory_order_relaxed);
+        unsigned long long read = this->readIndex.load(std::memory_order_acquire);
+        if (write - read >= SLOT_COUNT) {
+            this->droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        std::memcpy(slot(write), frame, this->frameSize);
+        if (colors != nullptr) {
+            // Only this thread resizes, and only before the first slot with colors is handed over
+            if (this->colorSlots.empty()) {
+                this->colorSlots.resize(SLOT_COUNT * this->frameSize);
+            }
+            std::memcpy(colorSlot(write), colors, this->frameSize * sizeof(uint32_t));
+        }
+        this->slotHasColors[write % SLOT_COUNT] = colors != nullptr;
+        this->slotRowBegin[write % SLOT_COUNT] = rowBegin;
+        this->slotRowEnd[write % SLOT_COUNT] = rowEnd;
+        {
+            std::lock_guard<std::mutex> lock(this->wakeMutex);
+            this->writeIndex.store(write + 1, std::memory_order_release);
+        }
+        this->wakeCondition.notify_one();
+        return true;
+    }
+
+    // Waits until every submitted frame has been written out
+    void flush() {
+        unsigned long long write = this->writeIndex.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(this->wakeMutex);
+        this->drainCondition.wait(lock, [&] { return this->readIndex.load(std::memory_order_acquire) >= write; });
+    }
+
+    void diff(bool isEnabled) {
+        this->isDiffEnabled.store(isEnabled);
+        this->isResetRequested.store(true);
+    }
+
+    void invalidate() {
+        this->isResetRequested.store(true);
+    }
+
+    void colors(ColorMode colorMode) {
+        this->colorMode.store(colorMode);
+        this->isResetRequested.store(true);
+    }
+
+    PresentStats getStats() const {
+        std::lock_guard<std::mutex> lock(this->statsMutex);
+        return this->stats;
+    }
+
+    unsigned long long dropped() const {
+        return this->droppedFrames.load(std::memory_order_relaxed);
+    }
+
+    // Frames submitted but not yet presented
+    unsigned int pending() const {
+        return (unsigned int)(this->writeIndex.load(std::memory_order_acquire) - this->readIndex.load(std::memory_order_acquire));
+    }
+
+private:
+    char* slot(unsigned long long index) {
+        return &this->slots[(index % SLOT_COUNT) * this->frameSize];
+    }
+
+    uint32_t* colorSlot(unsigned long long index) {
+        return &this->colorSlots[(index % SLOT_COUNT) * this->frameSize];
+    }
+
+    void presentLoop() {
+        while (true) {
+            unsigned long long read = this->readIndex.load(std::memory_order_relaxed);
+            if (read == this->writeIndex.load(std::memory_order_acquire)) {
+                std::unique_lock<std::mutex> lock(this->wakeMutex);
+                this->wakeCondition.wait(lock, [&] {
+                    return read != this->writeIndex.load(std::memory_order_acquire) || !this->isRunning.load();
+                });
+                if (read == this->writeIndex.load(std::memory_order_acquire)) {
+                    return;
+                }
+                continue;
+            }
+
+            if (this->output && !this->output->ready()) {
+                // Older frames are dropped as newer ones queue up, and the newest waits for room
+                if (this->writeIndex.load(std::memory_order_acquire) - read > 1) {
+                    this->droppedFrames.fetch_add(1, std::memory_order_relaxed);
+                    release(read);
+                } else {
+                    this->output->wait(std::chrono::milliseconds(1));
+                }
+                continue;
+            }
+
+            if (this->isResetRequested.exchange(false)) {
+                this->presenter.diff(this->isDiffEnabled.load());
+                this->presenter.colors(this->colorMode.load());
+            }
+
+            const uint32_t* colors = this->slotHasColors[read % SLOT_COUNT] ? colorSlot(read) : nullptr;
+            unsigned int rowBegin = this->slotRowBegin[read % SLOT_COUNT];
+            unsigned int rowEnd = this->slotRowEnd[read % SLOT_COUNT];
+            if (this->output) {
+                this->presenter.present(slot(read), colors, rowBegin, rowEnd, *this->output);
+            } else {
+                this->presenter.present(slot(read), colors, rowBegin, rowEnd, this->os);
+                this->os.flush();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(this->statsMutex);
+                this->stats = this->presenter.getStats();
+            }
+
+            release(read);
+        }
+    }
+
+    // Hands slot read back to the producer and wakes flush()
+    void release(unsigned long long read) {
+        {
+            std::lock_guard<std::mutex> lock(this->wakeMutex);
+            this->readIndex.store(read + 1, std::memory_order_release);
+        }
+        this->drainCondition.notify_all();
+    }
+};
@@ -0,0 +1,851 @@
+// COMPILE CODE: g++ -std=c++17 -O2 benchmark.cpp -o benchmark -pthread
+// RUN CODE: ./benchmark [benchmark names...], e.g. ./benchmark pipeline; runs every benchmark by default
+// Exits with 1 when a checked guarantee fails: steady_state allocating after its first frame, or
+// malformed_input loading a crafted file
+
+// The pipeline benchmark reads the renderer's stage timers
+#define RENDERER_INSTRUMENTATION
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "binarymesh.hpp"
+#include "bvh.hpp"
+#include "heart.hpp"
+#include "lirik.hpp"
+#include "mesh.hpp"
+#include "presenter.hpp"
+#include "renderer.hpp"
+#include "timeline.hpp"
+
+// Every heap allocation of the process, counted by the replaced global operator new below. Every
+// form of new and delete is replaced, all through countedAllocate() and countedFree(), so each
+// allocation is freed by the matching function whichever form releases it.
+std::atomic<unsigned long long> allocationCount(0);
+std::atomic<unsigned long long> allocatedBytes(0);
+
+// Kept out of line, so the compiler never pairs an inlined malloc with another form of delete
+__attribute__((noinline)) void* countedAllocate(size_t size, size_t align) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (align <= alignof(std::max_align_t)) {
+        return std::malloc(size > 0 ? size : 1);
+    }
+    size_t rounded = (size + align - 1) / align * align;
+#ifdef _WIN32
+    return _aligned_malloc(rounded > 0 ? rounded : align, align);
+#else
+    return std::aligned_alloc(align, rounded > 0 ? rounded : align);
+#endif
+}
+
+__attribute__((noinline)) void countedFree(void* data, size_t align) {
+#ifdef _WIN32
+    if (align > alignof(std::max_align_t)) {
+        _aligned_free(data);
+        return;
+    }
+#else
+    (void)align;
+#endif
+    std::free(data);
+}
+
+void* countedNew(size_t size, size_t align) {
+    if (void* data = countedAllocate(size, align)) {
+        return data;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) {
+    return countedNew(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return countedNew(size, 0);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return countedNew(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return countedNew(size, (size_t)alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, (size_t)alignment);
+}
+
+void operator delete(void* data) noexcept {
+    countedFree(data, 0);
+}
+
+void operator delete[](void* data) noexcept {
+    countedFree(data, 0);
+}
+
+void operator delete(void* data, size_t) noexcept {
+    countedFree(data, 0);
+}
+
+void operator delete[](void* data, size_t) noexcept {
+    countedFree(data, 0);
+}
+
+void operator delete(void* data, const std::nothrow_t&) noexcept {
+    countedFree(data, 0);
+}
+
+void operator delete[](void* data, const std::nothrow_t&) noexcept {
+    countedFree(data, 0);
+}
+
+void operator delete(void* data, std::align_val_t alignment) noexcept {
+    countedFree(data, (size_t)alignment);
+}
+
+void operator delete[](void* data, std::align_val_t alignment) noexcept {
+    countedFree(data, (size_t)alignment);
+}
+
+void operator delete(void* data, size_t, std::align_val_t alignment) noexcept {
+    countedFree(data, (size_t)alignment);
+}
+
+void operator delete[](void* data, size_t, std::align_val_t alignment) noexcept {
+    countedFree(data, (size_t)alignment);
+}
+
+void operator delete(void* data, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    countedFree(data, (size_t)alignment);
+}
+
+void operator delete[](void* data, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    countedFree(data, (size_t)alignment);
+}
+
+// Set when a benchmark finds a guarantee broken, e.g. steady_state allocating; main() returns it, so
+// CI running the benchmarks fails
+int exitStatus = 0;
+
+// Prints one JSON object per measurement so results can be collected and compared between commits
+void report(const std::string& benchmark, const std::string& variant, size_t triangles, double seconds) {
+    std::printf("{\"benchmark\": \"%s\", \"variant\": \"%s\", \"triangles\": %zu, \"seconds\": %.6f, \"triangles_per_second\": %.0f}\n",
+                benchmark.c_str(), variant.c_str(), triangles, seconds, seconds > 0 ? triangles / seconds : 0.0);
+    std::fflush(stdout);
+}
+
+// Swallows frames printed by Renderer::render() so only the JSON lines reach stdout
+class SilentOutput {
+private:
+    std::ostringstream sink;
+    std::streambuf* original;
+
+public:
+    SilentOutput() : original(std::cout.rdbuf(sink.rdbuf())) {}
+
+    ~SilentOutput() {
+        std::cout.rdbuf(this->original);
+    }
+};
+
+template <typename Function>
+double timeSeconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkMeshLoading() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::string objPath = (directory / "valentine_benchmark.obj").string();
+    std::string stlPath = (directory / "valentine_benchmark.stl").string();
+    std::string binaryPath = (directory / "valentine_benchmark.vmesh").string();
+
+    int sizes[][2] = { { 100, 200 }, { 500, 1000 }, { 1000, 2000 } };
+    for (auto& size : sizes) {
+        Mesh sphere = makeSphere(1.5f, size[0], size[1]);
+        size_t triangles = sphere.triangles.size() / 3;
+        saveObj(objPath, sphere);
+        saveStl(stlPath, sphere);
+        saveBinaryMesh(binaryPath, sphere);
+
+        Mesh loaded;
+        report("load", "obj", triangles, timeSeconds([&] { loaded = loadObj(objPath); }));
+        report("load", "stl", triangles, timeSeconds([&] { loaded = loadStl(stlPath); }));
+
+        Renderer renderer(80, 29, 50, 20, ' ', ".,-~:;=!*#$@", 0, 0.04f);
+        report("load", "stl_into_renderer", triangles, timeSeconds([&] { renderer.mesh(loadStl(stlPath)); }));
+
+        SilentOutput silent;
+
+        // Mapping plus the first render, which is where copied meshes pay for their streams and normals
+        report("first_render", "stl", triangles, timeSeconds([&] { renderer.mesh(loadStl(stlPath)); renderer.render(); }));
+        report("first_render", "binary_mapped", triangles, timeSeconds([&] {
+            MappedMesh mapped(binaryPath);
+            renderer.mesh(mapped);
+            renderer.render();
+        }));
+    }
+
+    std::remove(objPath.c_str());
+    std::remove(stlPath.c_str());
+    std::remove(binaryPath.c_str());
+}
+
+// Frame time with and without the BVH, for the whole sphere in view and zoomed in on part of it
+void benchmarkHierarchy() {
+    Mesh sphere = makeSphere(1.5f, 700, 1400);
+    size_t triangles = sphere.triangles.size() / 3;
+
+    SoAVertexBuffer vertices;
+    vertices.load(sphere.vertices.data(), sphere.vertices.size());
+    Bvh bvh;
+    report("bvh_build", "single_thread", triangles, timeSeconds([&] { bvh.build(vertices, sphere.triangles.data(), (unsigned int)triangles); }));
+
+    SilentOutput silent;
+    for (float zoom : { 1.0f, 4.0f }) {
+        for (bool isHierarchical : { false, true }) {
+            Renderer renderer(120, 40, 75 * zoom, 28 * zoom, ' ', ".,-~:;=!*#$@", 0, 0.02f);
+            renderer.mesh(Mesh(sphere));
+            renderer.rasterizer(RasterMode::ScreenSpace);
+            renderer.rotation(0.01f, 0.007f, 0.005f);
+            renderer.hierarchy(isHierarchical);
+            renderer.render();
+
+            int frames = 10;
+            double seconds = timeSeconds([&] {
+                for (int i = 0; i < frames; i++) {
+                    renderer.resetBuffers();
+                    renderer.render();
+                }
+            });
+            report("frame", std::string(isHierarchical ? "bvh" : "flat") + "_zoom" + std::to_string((int)zoom), triangles, seconds / frames);
+        }
+    }
+}
+
+// Square grids facing the camera, one behind the other, submitted nearest first or farthest first
+Mesh makeLayers(int layers, int grid, bool isNearestFirst) {
+    Mesh mesh;
+    for (int l = 0; l < layers; l++) {
+        int layer = isNearestFirst ? l : layers - 1 - l;
+        float z = -2.0f + 3.0f * layer / layers;
+        int base = (int)mesh.vertices.size();
+
+        for (int j = 0; j <= grid; j++) {
+            for (int i = 0; i <= grid; i++) {
+                mesh.vertices.push_back(Vec3<float>(-2 + 4.0f * i / grid, -2 + 4.0f * j / grid, z));
+            }
+        }
+        for (int j = 0; j < grid; j++) {
+            for (int i = 0; i < grid; i++) {
+                int corner = base + i + j * (grid + 1);
+                int quad[6] = { corner, corner + 1, corner + grid + 2, corner, corner + grid + 2, corner + grid + 1 };
+                mesh.triangles.insert(mesh.triangles.end(), quad, quad + 6);
+            }
+        }
+    }
+    return mesh;
+}
+
+// Frame time with and without the coarse depth test on 20 overlapping layers. Drawn nearest first
+// most triangles are rejected early; drawn farthest first none can be, which shows the test's cost.
+void benchmarkEarlyDepth() {
+    SilentOutput silent;
+    for (RasterMode mode : { RasterMode::ScreenSpace, RasterMode::ObjectScan }) {
+        for (bool isNearestFirst : { true, false }) {
+            for (bool isEarly : { false, true }) {
+                Mesh layers = makeLayers(20, 16, isNearestFirst);
+                size_t triangles = layers.triangles.size() / 3;
+
+                Renderer renderer(400, 160, 250, 112, ' ', ".,-~:;=!*#$@", 0, 0.02f);
+                renderer.mesh(std::move(layers));
+                renderer.light(5.0f, Vec3<float>(0.3f, -0.2f, 1.0f), 10);
+                renderer.rasterizer(mode);
+                renderer.rotation(0.0f, 0.02f, 0.0f);
+                renderer.earlyDepthTest(isEarly);
+                renderer.render();
+
+                int frames = 10;
+                unsigned long long rejected = 0;
+                double seconds = timeSeconds([&] {
+                    for (int i = 0; i < frames; i++) {
+                        renderer.resetBuffers();
+                        renderer.render();
+                        rejected += renderer.cullStats().depthRejected;
+                    }
+                });
+
+                std::string variant = std::string(mode == RasterMode::ScreenSpace ? "screen_space" : "object_scan")
+                                    + (isNearestFirst ? "_nearest_first" : "_farthest_first") + (isEarly ? "_early" : "");
+                report("early_depth", variant, triangles, seconds / frames);
+                std::printf("{\"benchmark\": \"early_depth\", \"variant\": \"%s\", \"rejected_triangles_per_frame\": %llu}\n",
+                            variant.c_str(), rejected / frames);
+            }
+        }
+    }
+}
+
+// Frame time of a dense sphere moving away from the camera, drawn in full and with levels of detail
+void benchmarkLevelOfDetail() {
+    Mesh sphere = makeSphere(1.5f, 300, 600);
+    size_t triangles = sphere.triangles.size() / 3;
+
+    SoAVertexBuffer vertices;
+    vertices.load(sphere.vertices.data(), sphere.vertices.size());
+    LodChain lods;
+    report("lod_build", "single_thread", triangles, timeSeconds([&] { lods.build(vertices, sphere.triangles.data(), (unsigned int)triangles); }));
+
+    SilentOutput silent;
+    for (float distance : { 3.0f, 10.0f, 80.0f }) {
+        for (bool isDetailed : { false, true }) {
+            Renderer renderer(120, 40, 300, 112, ' ', ".,-~:;=!*#$@", 0, 0.02f);
+            renderer.mesh(Mesh(sphere));
+            renderer.light(distance, Vec3<float>(0.3f, -0.2f, -1.0f), 10);
+            renderer.rasterizer(RasterMode::ScreenSpace);
+            renderer.rotation(0.01f, 0.007f, 0.005f);
+            renderer.levelOfDetail(isDetailed);
+            renderer.render();
+
+            int frames = 10;
+            double seconds = timeSeconds([&] {
+                for (int i = 0; i < frames; i++) {
+                    renderer.resetBuffers();
+                    renderer.render();
+                }
+            });
+
+            std::string variant = std::string(isDetailed ? "lod" : "full") + "_distance" + std::to_string((int)distance);
+            report("lod_frame", variant, triangles, seconds / frames);
+            std::printf("{\"benchmark\": \"lod_frame\", \"variant\": \"%s\", \"level\": %zu, \"drawn_triangles\": %llu}\n",
+                        variant.c_str(), renderer.currentDetailLevel(), renderer.cullStats().triangles);
+        }
+    }
+}
+
+// Frame time of a grid of instances sharing one sphere mesh, all drawn into the same buffers
+void benchmarkInstancing() {
+    SilentOutput silent;
+    for (int side : { 1, 4, 16 }) {
+        Renderer renderer(160, 50, 100, 38, ' ', ".,-~:;=!*#$@", 0, 0.02f);
+        unsigned int sphere = renderer.addModel(makeSphere(0.4f, 40, 80));
+        renderer.light(12.0f, Vec3<float>(0.3f, -0.2f, -1.0f), 10);
+        renderer.rasterizer(RasterMode::ScreenSpace);
+        renderer.rotation(0.0f, 0.01f, 0.0f);
+
+        std::vector<Mat4<float>> transforms;
+        for (int j = 0; j < side; j++) {
+            for (int i = 0; i < side; i++) {
+                float spacing = 8.0f / side;
+                transforms.push_back(Mat4<float>::translation(Vec3<float>((i - (side - 1) / 2.0f) * spacing, (j - (side - 1) / 2.0f) * spacing, 0))
+                                   * Mat4<float>::scale(Vec3<float>(spacing, spacing, spacing)));
+                renderer.addInstance(sphere, transforms.back());
+            }
+        }
+        renderer.render();
+
+        int frames = 10;
+        double seconds = timeSeconds([&] {
+            for (int i = 0; i < frames; i++) {
+                renderer.instanceTransforms(1, (unsigned int)transforms.size(), transforms.data());
+                renderer.resetBuffers();
+                renderer.render();
+            }
+        });
+        report("instancing", std::to_string(side * side) + "_instances", (size_t)renderer.cullStats().triangles, seconds / frames);
+    }
+}
+
+// Flat against smooth shading on a sphere filling most of the screen, for both raster modes
+void benchmarkShading() {
+    Mesh sphere = makeSphere(1.8f, 160, 320);
+    for (RasterMode mode : { RasterMode::ScreenSpace, RasterMode::ObjectScan }) {
+        for (ShadingMode shading : { ShadingMode::Flat, ShadingMode::Smooth }) {
+            Renderer renderer(160, 50, 100, 38, ' ', ".,-~:;=!*#$@", 0, 0.02f);
+            renderer.mesh(Mesh(sphere));
+            renderer.light(5.0f, Vec3<float>(0.3f, -0.2f, -1.0f), 10);
+            renderer.rotation(0.0f, 0.01f, 0.0f);
+            renderer.rasterizer(mode);
+            renderer.shading(shading);
+            renderer.headless(true);
+            renderer.render();
+
+            int frames = 10;
+            double seconds = timeSeconds([&] {
+                for (int i = 0; i < frames; i++) {
+                    renderer.resetBuffers();
+                    renderer.render();
+                }
+            });
+            std::string variant = std::string(mode == RasterMode::ScreenSpace ? "screen_space" : "object_scan")
+                                + (shading == ShadingMode::Smooth ? "_smooth" : "_flat");
+            report("shading", variant, sphere.triangles.size() / 3, seconds / frames);
+        }
+    }
+}
+
+struct PipelineMesh {
+    std::string name;
+    Mesh mesh;
+};
+
+// Heart, spheres and tori from hundreds to millions of triangles
+std::vector<PipelineMesh> makePipelineMeshes() {
+    std::vector<PipelineMesh> meshes;
+    meshes.push_back({ "heart", Mesh{ std::vector<Vec3<float>>(heartVertices, heartVertices + 50), std::vector<int>(heartTriangles, heartTriangles + 285) } });
+    for (int rings : { 10, 50, 160, 700 }) {
+        meshes.push_back({ "sphere_" + std::to_string(rings), makeSphere(1.8f, rings, 2 * rings) });
+        meshes.push_back({ "torus_" + std::to_string(rings), makeTorus(1.3f, 0.5f, rings, 2 * rings) });
+    }
+    return meshes;
+}
+
+// The whole pipeline, headless, for every mesh, resolution and raster mode. ObjectScan is run at
+// several scanSteps; ScreenSpace does not use it. The present stage is the cost of composing the
+// frame for the terminal, measured separately since headless rendering skips it. Allocations are
+// counted over the timed frames only, after a first render has set everything up.
+void benchmarkPipeline() {
+    struct Resolution {
+        unsigned int width, height;
+    };
+    Resolution resolutions[] = { { 80, 29 }, { 160, 50 }, { 320, 100 } };
+
+    struct Variant {
+        RasterMode mode;
+        float scanStep;
+    };
+    Variant variants[] = { { RasterMode::ScreenSpace, 0.04f }, { RasterMode::ObjectScan, 0.02f },
+                           { RasterMode::ObjectScan, 0.04f }, { RasterMode::ObjectScan, 0.08f } };
+
+    for (const PipelineMesh& entry : makePipelineMeshes()) {
+        size_t triangles = entry.mesh.triangles.size() / 3;
+        for (const Resolution& resolution : resolutions) {
+            for (const Variant& variant : variants) {
+                // The heart's proportions from main.cpp, scaled with the screen
+                Renderer renderer(resolution.width, resolution.height, 50.0f * resolution.width / 80, 20.0f * resolution.height / 29,
+                                  ' ', ".,-~:;=!*#$@", 0, variant.scanStep);
+                renderer.mesh(Mesh(entry.mesh));
+                renderer.light(5.0f, Vec3<float>(0.0f, 0.0f, -1.0f), 10);
+                renderer.rotation(0.01f, 0.03f, 0.0f);
+                renderer.rasterizer(variant.mode);
+                renderer.headless(true);
+                renderer.resetBuffers();
+                renderer.render();
+
+                TerminalPresenter presenter(resolution.width, resolution.height);
+                StageTimes stages;
+                double presentSeconds = 0;
+                int frames = 0;
+
+                unsigned long long allocations = allocationCount.load();
+                unsigned long long bytes = allocatedBytes.load();
+                double seconds = timeSeconds([&] {
+                    // At least 3 frames, then until 20 frames or a quarter second
+                    auto start = std::chrono::steady_clock::now();
+                    while (frames < 3 || (frames < 20 && std::chrono::steady_clock::now() - start < std::chrono::milliseconds(250))) {
+                        renderer.resetBuffers();
+                        renderer.render();
+                        presentSeconds += timeSeconds([&] { presenter.compose(renderer.characterPlane()); });
+
+                        StageTimes frame = renderer.frameStats().times;
+                        stages.transform += frame.transform;
+                        stages.setup += frame.setup;
+                        stages.rasterize += frame.rasterize;
+                        frames++;
+                    }
+                });
+                allocations = allocationCount.load() - allocations;
+                bytes = allocatedBytes.load() - bytes;
+
+                double frameSeconds = seconds / frames;
+                std::printf("{\"benchmark\": \"pipeline\", \"mesh\": \"%s\", \"triangles\": %zu, \"width\": %u, \"height\": %u, "
+                            "\"mode\": \"%s\", \"scan_step\": %.3f, \"frames\": %d, \"seconds\": %.6f, "
+                            "\"transform_seconds\": %.6f, \"setup_seconds\": %.6f, \"rasterize_seconds\": %.6f, \"present_seconds\": %.6f, "
+                            "\"triangles_per_second\": %.0f, \"cells_per_second\": %.0f, "
+                            "\"allocations_per_frame\": %.1f, \"allocated_bytes_per_frame\": %.0f}\n",
+                            entry.name.c_str(), triangles, resolution.width, resolution.height,
+                            variant.mode == RasterMode::ScreenSpace ? "screen_space" : "object_scan",
+                            variant.mode == RasterMode::ScreenSpace ? 0.0f : variant.scanStep, frames, frameSeconds,
+                            stages.transform / frames, stages.setup / frames, stages.rasterize / frames, presentSeconds / frames,
+                            triangles / frameSeconds, resolution.width * resolution.height / frameSeconds,
+                            (double)allocations / frames, (double)bytes / frames);
+                std::fflush(stdout);
+            }
+        }
+    }
+}
+
+// Heap allocations after the first frame, which must be none, for each raster mode with threads,
+// hierarchy, early depth, levels of detail and instances on and off. The scene moves towards the
+// camera and back, and the frames are composed for the terminal as well.
+void benchmarkSteadyState() {
+    struct Config {
+        const char* name;
+        RasterMode mode;
+        unsigned int threads;
+        bool isHierarchical;
+        bool isDetailed;
+        int instances;
+    };
+    Config configs[] = {
+        { "object_scan", RasterMode::ObjectScan, 1, false, false, 1 },
+        { "object_scan_hierarchy", RasterMode::ObjectScan, 1, true, false, 1 },
+        { "screen_space", RasterMode::ScreenSpace, 1, false, false, 1 },
+        { "screen_space_hierarchy", RasterMode::ScreenSpace, 1, true, false, 1 },
+        { "screen_space_threads", RasterMode::ScreenSpace, 4, false, false, 1 },
+        { "screen_space_threads_hierarchy", RasterMode::ScreenSpace, 4, true, false, 1 },
+        { "screen_space_lod_instances", RasterMode::ScreenSpace, 4, false, true, 16 },
+    };
+
+    for (const Config& config : configs) {
+        Renderer renderer(160, 50, 100, 34, ' ', ".,-~:;=!*#$@", 0, 0.04f);
+        renderer.mesh(makeSphere(1.5f, 60, 120));
+        renderer.light(5.0f, Vec3<float>(0.3f, -0.2f, -1.0f), 10);
+        renderer.rotation(0.03f, 0.05f, 0.01f);
+        renderer.rasterizer(config.mode);
+        renderer.threads(config.threads);
+        renderer.hierarchy(config.isHierarchical);
+        renderer.earlyDepthTest(config.isHierarchical);
+        renderer.levelOfDetail(config.isDetailed);
+        renderer.headless(true);
+        for (int i = 1; i < config.instances; i++) {
+            renderer.addInstance(0, Mat4<float>::translation(Vec3<float>((i % 4) - 1.5f, (i / 4) - 1.5f, i * 0.5f)));
+        }
+        TerminalPresenter presenter(160, 50);
+
+        // The nearest pose comes first, so later frames never need more than the first
+        int frames = 200;
+        unsigned long long allocations = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            renderer.translation(Vec3<float>(std::sin(frame * 0.05f) * 2, 0.0f, 2.0f - std::cos(frame * 0.03f) * 2));
+            unsigned long long before = allocationCount.load();
+            renderer.resetBuffers();
+            renderer.render();
+            presenter.compose(renderer.characterPlane());
+            if (frame > 0) {
+                allocations += allocationCount.load() - before;
+            }
+        }
+
+        std::printf("{\"benchmark\": \"steady_state\", \"variant\": \"%s\", \"frames\": %d, \"allocations_after_first_frame\": %llu, "
+                    "\"frame_arena_bytes\": %zu, \"frame_arena_growths\": %llu}\n",
+                    config.name, frames - 1, allocations, renderer.frameMemory().capacity(), renderer.frameMemory().growths());
+        std::fflush(stdout);
+        if (allocations > 0) {
+            std::fprintf(stderr, "steady_state FAILED: %s allocated %llu times after the first frame\n", config.name, allocations);
+            exitStatus = 1;
+        }
+    }
+}
+
+// The heart turning once every 120 frames while bobbing twice: drawn every frame, served from a frame
+// cache after its first cycle, and served from a cycle precomputed in the background
+void benchmarkFrameCache() {
+    const unsigned int cycle = 120;
+    auto makeRenderer = [] {
+        std::unique_ptr<Renderer> renderer(new Renderer(160, 50, 100, 38, ' ', ".,-~:;=!*#$@", 0, 0.02f));
+        renderer->vertex(50, heartVertices);
+        renderer->triangle(285, heartTriangles);
+        renderer->light(5.0f, Vec3<float>(0.0f, 0.0f, -1.0f), 10);
+        renderer->rotation(0.0f, (float)(2 * M_PI / cycle), 0.0f);
+        renderer->headless(true);
+        return renderer;
+    };
+    auto pose = [](Renderer& renderer, unsigned int frame) {
+        renderer.translation(Vec3<float>(0.0f, std::sin(frame * (float)(4 * M_PI / cycle)) / 2, 0.0f));
+    };
+
+    for (const char* variant : { "uncached", "cached", "precomputed" }) {
+        std::unique_ptr<Renderer> renderer = makeRenderer();
+        std::shared_ptr<FrameCache> cache;
+        if (std::string(variant) != "uncached") {
+            cache = std::make_shared<FrameCache>(4 << 20);
+            renderer->frameCache(cache);
+        }
+
+        double warmup = 0;
+        unsigned int frame = 0;
+        if (std::string(variant) == "precomputed") {
+            warmup = timeSeconds([&] {
+                renderer->precompute(makeRenderer(), cycle, pose);
+                while (renderer->isPrecomputing()) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            });
+        } else {
+            warmup = timeSeconds([&] {
+                for (; frame < cycle; frame++) {
+                    pose(*renderer, frame);
+                    renderer->resetBuffers();
+                    renderer->render();
+                }
+            });
+        }
+
+        unsigned int frames = 4 * cycle;
+        double seconds = timeSeconds([&] {
+            for (unsigned int i = 0; i < frames; i++, frame++) {
+                pose(*renderer, frame);
+                renderer->resetBuffers();
+                renderer->render();
+            }
+        });
+
+        FrameCacheStats stats = cache ? cache->getStats() : FrameCacheStats();
+        std::printf("{\"benchmark\": \"frame_cache\", \"variant\": \"%s\", \"frames\": %u, \"seconds_per_frame\": %.6f, "
+                    "\"first_cycle_seconds\": %.6f, \"hits\": %llu, \"misses\": %llu, \"cached_frames\": %zu, \"cache_bytes\": %zu}\n",
+                    variant, frames, seconds / frames, warmup, stats.hits, stats.misses, stats.frames, stats.bytes);
+        std::fflush(stdout);
+    }
+}
+
+// Bytes written per frame for the turning, bobbing heart and two colored spheres, without colors and
+// with each color mode and number of brightness bands
+void benchmarkColor() {
+    struct Config {
+        const char* name;
+        ColorMode mode;
+        unsigned int levels;
+    };
+    Config configs[] = {
+        { "monochrome", ColorMode::Monochrome, 1 },
+        { "palette256_1_level", ColorMode::Palette256, 1 },
+        { "palette256_2_levels", ColorMode::Palette256, 2 },
+        { "palette256_12_levels", ColorMode::Palette256, 12 },
+        { "truecolor_1_level", ColorMode::TrueColor, 1 },
+        { "truecolor_2_levels", ColorMode::TrueColor, 2 },
+        { "truecolor_12_levels", ColorMode::TrueColor, 12 },
+    };
+
+    SilentOutput silent;
+    for (const Config& config : configs) {
+        Renderer renderer(120, 40, 75, 28, ' ', ".,-~:;=!*#$@", 0, 0.02f);
+        renderer.vertex(50, heartVertices);
+        renderer.triangle(285, heartTriangles);
+        unsigned int sphere = renderer.addModel(makeSphere(0.6f, 20, 40));
+        renderer.addInstance(sphere, Mat4<float>::translation(Vec3<float>(-2.0f, 0.0f, 0.0f)));
+        renderer.addInstance(sphere, Mat4<float>::translation(Vec3<float>(2.0f, 0.0f, 0.0f)));
+        renderer.instanceColor(0, 0xFF2040);
+        renderer.instanceColor(1, 0x40A0FF);
+        renderer.instanceColor(2, 0xFFD040);
+        renderer.light(5.0f, Vec3<float>(0.3f, -0.2f, -1.0f), 10);
+        renderer.rotation(0.0f, 0.03f, 0.0f);
+        renderer.colorOutput(config.mode, config.levels);
+
+        int frames = 200;
+        double seconds = timeSeconds([&] {
+            for (int frame = 0; frame < frames; frame++) {
+                renderer.translation(Vec3<float>(0.0f, std::sin(frame * 0.04f) / 2, 0.0f));
+                renderer.resetBuffers();
+                renderer.render();
+            }
+        });
+
+        PresentStats stats = renderer.presentStats();
+        std::printf("{\"benchmark\": \"color\", \"variant\": \"%s\", \"frames\": %d, \"bytes_per_frame\": %.0f, "
+                    "\"color_bytes_per_frame\": %.0f, \"seconds_per_frame\": %.6f}\n",
+                    config.name, frames, (double)stats.totalBytes / stats.frames, (double)stats.totalColorBytes / stats.frames, seconds / frames);
+        std::fflush(stdout);
+    }
+}
+
+// The intro of main.cpp drawn over the model at 50 frames per second of timeline time, against the
+// model alone. The blocking intro kept the first frame back for its whole length.
+void benchmarkTimeline() {
+    SilentOutput silent;
+    for (const char* variant : { "model_only", "with_intro" }) {
+        Renderer renderer(80, 29, 50, 20, ' ', ".,-~:;=!*#$@", 0, 0.04f);
+        renderer.vertex(50, heartVertices);
+        renderer.triangle(285, heartTriangles);
+        renderer.light(5.0f, Vec3<float>(0.0f, 0.0f, -1.0f), 10);
+        renderer.rotation(0.0f, 0.03f, 0.0f);
+        renderer.colorOutput(ColorMode::Palette256);
+        renderer.instanceColor(0, 0xFF5555);
+
+        Timeline intro;
+        double lyricsEnd = scheduleLirik(intro, 0.0, renderer.getWidth(), 1, 0xAA00AA);
+        intro.text(lyricsEnd, lyricsEnd + 2.1, 25, 1, "--- Sending my love to you ---", 0, 0xFFFF55);
+        intro.progressBar(lyricsEnd, 1.6, lyricsEnd + 2.1, 6, 2, 53, 0xFF5555);
+        if (std::string(variant) == "with_intro") {
+            renderer.overlay([&](Renderer& target) { intro.draw(target); });
+        }
+
+        int frames = (int)(intro.duration() * 50);
+        double seconds = timeSeconds([&] {
+            for (int frame = 0; frame < frames; frame++) {
+                intro.seek(frame * 0.02);
+                renderer.translation(Vec3<float>(0.0f, std::sin(frame * 0.04f) / 2, 0.0f));
+                renderer.resetBuffers();
+                renderer.render();
+            }
+        });
+
+        PresentStats stats = renderer.presentStats();
+        std::printf("{\"benchmark\": \"timeline\", \"variant\": \"%s\", \"frames\": %d, \"intro_seconds\": %.3f, "
+                    "\"bytes_per_frame\": %.0f, \"seconds_per_frame\": %.6f}\n",
+                    variant, frames, intro.duration(), (double)stats.totalBytes / stats.frames, seconds / frames);
+        std::fflush(stdout);
+    }
+}
+
+// Loads that must fail with an error mentioning message; anything else fails the run
+void expectRejected(const char* variant, const std::string& message, std::function<void()> load) {
+    std::string error;
+    try {
+        load();
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    bool isRejected = error.find(message) != std::string::npos;
+    std::printf("{\"benchmark\": \"malformed_input\", \"variant\": \"%s\", \"rejected\": %s}\n", variant, isRejected ? "true" : "false");
+    std::fflush(stdout);
+    if (!isRejected) {
+        std::fprintf(stderr, "malformed_input FAILED: %s was not rejected with \"%s\"%s%s\n", variant, message.c_str(),
+                     error.empty() ? "" : ", got: ", error.c_str());
+        exitStatus = 1;
+    }
+}
+
+// Crafted files the loaders must reject, each once mishandled
+void benchmarkMalformedInput() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::string binaryPath = (directory / "valentine_malformed.vmesh").string();
+
+    // A vertex offset near 2^64 wraps around when the section size is added to it
+    saveBinaryMesh(binaryPath, makeSphere(1.5f, 10, 20));
+    {
+        std::FILE* file = std::fopen(binaryPath.c_str(), "r+b");
+        uint64_t vertexOffset = ~(uint64_t)(BINARY_MESH_ALIGNMENT - 1);
+        std::fseek(file, offsetof(BinaryMeshHeader, vertexOffset), SEEK_SET);
+        std::fwrite(&vertexOffset, sizeof(vertexOffset), 1, file);
+        std::fclose(file);
+    }
+    expectRejected("binary_wrapped_vertex_offset", "Corrupt binary mesh header", [&] { MappedMesh mapped(binaryPath); });
+    std::remove(binaryPath.c_str());
+
+    // A face index of more digits than any integer type holds
+    std::string objPath = (directory / "valentine_malformed.obj").string();
+    {
+        std::FILE* file = std::fopen(objPath.c_str(), "wb");
+        std::fputs("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 99999999999999999999999999999999\n", file);
+        std::fclose(file);
+    }
+    expectRejected("obj_oversized_index", "Face index out of range", [&] { loadObj(objPath); });
+    std::remove(objPath.c_str());
+}
+
+#ifndef _WIN32
+// Full repaints written to a 16 KB pipe drained at about 250 KB/s, a quarter of what the render
+// loop produces at 200 frames per second. Blocking writes stall render(); with a non-blocking fd it keeps
+// its 5ms per frame and drops what the pipe cannot take.
+void benchmarkOutput() {
+    for (const char* variant : { "fd_blocking", "fd_nonblocking", "fd_nonblocking_async" }) {
+        int pipeFds[2];
+        if (pipe(pipeFds) != 0) {
+            return;
+        }
+#ifdef F_SETPIPE_SZ
+        fcntl(pipeFds[1], F_SETPIPE_SZ, 16 << 10);
+#endif
+        std::thread reader([&] {
+            char chunk[512];
+            while (read(pipeFds[0], chunk, sizeof(chunk)) > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        });
+
+        Renderer renderer(120, 40, 75, 28, ' ', ".,-~:;=!*#$@", 0, 0.02f);
+        renderer.vertex(50, heartVertices);
+        renderer.triangle(285, heartTriangles);
+        renderer.light(5.0f, Vec3<float>(0.0f, 0.0f, -1.0f), 10);
+        renderer.rotation(0.0f, 0.03f, 0.0f);
+        renderer.frameRate(200.0f);
+        renderer.diffOutput(false);
+
+        std::shared_ptr<FdOutput> output = std::make_shared<FdOutput>(pipeFds[1], std::string(variant) != "fd_blocking");
+        renderer.output(output);
+        renderer.asyncOutput(std::string(variant) == "fd_nonblocking_async");
+
+        int frames = 400;
+        double seconds = timeSeconds([&] {
+            for (int frame = 0; frame < frames; frame++) {
+                renderer.translation(Vec3<float>(0.0f, std::sin(frame * 0.04f) / 2, 0.0f));
+                renderer.resetBuffers();
+                renderer.render();
+            }
+        });
+
+        unsigned long long dropped = renderer.droppedFrames();
+        renderer.output(nullptr);
+        renderer.asyncOutput(false);
+        OutputStats stats = output->getStats();
+        output.reset();
+        close(pipeFds[1]);
+        reader.join();
+        close(pipeFds[0]);
+
+        std::printf("{\"benchmark\": \"output\", \"variant\": \"%s\", \"frames\": %d, \"seconds_per_frame\": %.6f, "
+                    "\"dropped_frames\": %llu, \"written_frames\": %llu, \"write_calls\": %llu, \"partial_writes\": %llu}\n",
+                    variant, frames, seconds / frames, dropped, stats.frames, stats.writeCalls, stats.partialWrites);
+        std::fflush(stdout);
+    }
+}
+#endif
+
+int main(int argc, char** argv) {
+    std::pair<const char*, std::function<void()>> benchmarks[] = {
+        { "pipeline", benchmarkPipeline },
+        { "loading", benchmarkMeshLoading },
+        { "hierarchy", benchmarkHierarchy },
+        { "early_depth", benchmarkEarlyDepth },
+        { "lod", benchmarkLevelOfDetail },
+        { "instancing", benchmarkInstancing },
+        { "shading", benchmarkShading },
+        { "steady_state", benchmarkSteadyState },
+        { "frame_cache", benchmarkFrameCache },
+        { "color", benchmarkColor },
+        { "timeline", benchmarkTimeline },
+        { "malformed_input", benchmarkMalformedInput },
+#ifndef _WIN32
+        { "output", benchmarkOutput },
+#endif
+    };
+
+    for (auto& benchmark : benchmarks) {
+        bool isSelected = argc == 1;
+        for (int i = 1; i < argc; i++) {
+            isSelected = isSelected || std::string(argv[i]) == benchmark.first;
+        }
+        if (isSelected) {
+            benchmark.second();
+        }
+    }
+    return exitStatus;
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "geometry.hpp"
+#include "mesh.hpp"
+#include "simd.hpp"
+
+// Compact binary mesh laid out exactly as the renderer consumes it, so it can be mapped and used
+// in place. All values are in the byte order of the host that wrote the file, so files only move
+// between hosts of the same order; the version field doubles as the byte-order mark, and a file from
+// a host of the other order is rejected on load. Every section starts on a BINARY_MESH_ALIGNMENT boundary:
+//
+//   header    BinaryMeshHeader
+//   vertices  x[vertexStride], y[vertexStride], z[vertexStride]            float32
+//   normals   x[normalStride], y[normalStride], z[normalStride]            float32, one per face
+//   indices   3 * triangleCount                                            uint32, or uint16 with BINARY_MESH_SHORT_INDICES
+//
+// Strides are counts padded to SIMD_WIDTH, with zeros in the padding, as SoAVertexBuffer expects.
+
+const char BINARY_MESH_MAGIC[8] = { 'V', 'A', 'L', 'M', 'E', 'S', 'H', '\0' };
+const uint32_t BINARY_MESH_VERSION = 1;
+const uint32_t BINARY_MESH_SHORT_INDICES = 1;
+const size_t BINARY_MESH_ALIGNMENT = 64;
+
+struct BinaryMeshHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t vertexStride;
+    uint32_t normalStride;
+    uint64_t vertexOffset;
+    uint64_t normalOffset;
+    uint64_t indexOffset;
+    uint64_t fileSize;
+};
+
+static_assert(sizeof(BinaryMeshHeader) == 64, "BinaryMeshHeader must stay 64 bytes");
+
+inline uint32_t byteSwapped(uint32_t value) {
+    return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+}
+
+inline uint64_t alignOffset(uint64_t offset) {
+    return (offset + BINARY_MESH_ALIGNMENT - 1) / BINARY_MESH_ALIGNMENT * BINARY_MESH_ALIGNMENT;
+}
+
+// Writes mesh with precomputed face normals. 16-bit indices are used whenever every index fits.
+inline void saveBinaryMesh(const std::string& path, const Mesh& mesh) {
+    if (mesh.vertices.empty() || mesh.triangles.empty() || mesh.triangles.size() % 3 != 0) {
+        throw std::invalid_argument("Mesh Save Error: Invalid mesh!");
+    }
+
+    BinaryMeshHeader header;
+    std::memcpy(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic));
+    header.version = BINARY_MESH_VERSION;
+    header.vertexCount = (uint32_t)mesh.vertices.size();
+    header.triangleCount = (uint32_t)(mesh.triangles.size() / 3);
+    header.flags = header.vertexCount <= 65536 ? BINARY_MESH_SHORT_INDICES : 0;
+    header.vertexStride = (uint32_t)paddedLength(header.vertexCount);
+    header.normalStride = (uint32_t)paddedLength(header.triangleCount);
+
+    size_t indexSize = (header.flags & BINARY_MESH_SHORT_INDICES) ? 2 : 4;
+    header.vertexOffset = alignOffset(sizeof(BinaryMeshHeader));
+    header.normalOffset = alignOffset(header.vertexOffset + 3ULL * header.vertexStride * sizeof(float));
+    header.indexOffset = alignOffset(header.normalOffset + 3ULL * header.normalStride * sizeof(float));
+    header.fileSize = alignOffset(header.indexOffset + 3ULL * header.triangleCount * indexSize);
+
+    std::vector<char> file((size_t)header.fileSize, 0);
+    std::memcpy(file.data(), &header, sizeof(header));
+
+    float* vx = (float*)(file.data() + header.vertexOffset);
+    float* vy = vx + header.vertexStride;
+    float* vz = vy + header.vertexStride;
+    for (uint32_t i = 0; i < header.vertexCount; i++) {
+        vx[i] = mesh.vertices[i].x;
+        vy[i] = mesh.vertices[i].y;
+        vz[i] = mesh.vertices[i].z;
+    }
+
+    // Same normals Renderer derives on first render
+    float* nx = (float*)(file.data() + header.normalOffset);
+    float* ny = nx + header.normalStride;
+    float* nz = ny + header.normalStride;
+    for (uint32_t i = 0; i < header.triangleCount; i++) {
+        const Vec3<float>& v0 = mesh.vertices[mesh.triangles[3 * i]];
+        const Vec3<float>& v1 = mesh.vertices[mesh.triangles[3 * i + 1]];
+        const Vec3<float>& v2 = mesh.vertices[mesh.triangles[3 * i + 2]];
+        Vec3<float> n = (v1 - v0) ^ (v2 - v1);
+        n.normalize();
+        nx[i] = n.x;
+        ny[i] = n.y;
+        nz[i] = n.z;
+    }
+
+    char* indices = file.data() + header.indexOffset;
+    for (size_t i = 0; i < mesh.triangles.size(); i++) {
+        if (indexSize == 2) {
+            uint16_t index = (uint16_t)mesh.triangles[i];
+            std::memcpy(indices + 2 * i, &index, 2);
+        } else {
+            uint32_t index = (uint32_t)mesh.triangles[i];
+            std::memcpy(indices + 4 * i, &index, 4);
+        }
+    }
+
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (out == nullptr) {
+        throw std::runtime_error("Mesh Save Error: Cannot open " + path);
+    }
+    size_t written = std::fwrite(file.data(), 1, file.size(), out);
+    std::fclose(out);
+    if (written != file.size()) {
+        throw std::runtime_error("Mesh Save Error: Short write to " + path);
+    }
+}
+
+// Read-only memory mapping of a binary mesh. Vertex and normal arrays always point into the mapping;
+// 32-bit indices do too, while 16-bit indices are widened once into an owned array.
+// Pass it to Renderer::mesh(const MappedMesh&) and keep it alive while the renderer uses it.
+class MappedMesh {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    const BinaryMeshHeader* header = nullptr;
+    std::vector<int> widenedIndices;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    // validateIndices reads every index once to reject out-of-range values
+    explicit MappedMesh(const std::string& path, bool validateIndices = true) {
+        map(path);
+
+        try {
+            validate(path, validateIndices);
+        } catch (...) {
+            unmap();
+            throw;
+        }
+    }
+
+    MappedMesh(const MappedMesh&) = delete;
+    MappedMesh& operator=(const MappedMesh&) = delete;
+
+    ~MappedMesh() {
+        unmap();
+    }
+
+    unsigned int vertexCount() const {
+        return this->header->vertexCount;
+    }
+
+    unsigned int triangleCount() const {
+        return this->header->triangleCount;
+    }
+
+    const float* vertexX() const { return section(this->header->vertexOffset); }
+    const float* vertexY() const { return vertexX() + this->header->vertexStride; }
+    const float* vertexZ() const { return vertexY() + this->header->vertexStride; }
+
+    const float* normalX() const { return section(this->header->normalOffset); }
+    const float* normalY() const { return normalX() + this->header->normalStride; }
+    const float* normalZ() const { return normalY() + this->header->normalStride; }
+
+    const int* triangles() const {
+        if (!this->widenedIndices.empty()) {
+            return this->widenedIndices.data();
+        }
+        return reinterpret_cast<const int*>(this->data + this->header->indexOffset);
+    }
+
+    // True when the indices are used straight from the mapping as well
+    bool isZeroCopy() const {
+        return this->widenedIndices.empty();
+    }
+
+private:
+    const float* section(uint64_t offset) const {
+        return reinterpret_cast<const float*>(this->data + offset);
+    }
+
+    void map(const std::string& path) {
+#ifdef _WIN32
+        this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (this->file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Mesh Load Error: Cannot open " + path);
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(this->file, &fileSize);
+        this->size = (size_t)fileSize.QuadPart;
+
+        this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (this->mapping != nullptr) {
+            this->data = (const char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        if (this->data == nullptr) {
+            unmap();
+            throw std::runtime_error("Mesh Load Error: Cannot map " + path);
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Mesh Load Error: Cannot open " + path);
+        }
+
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(BinaryMeshHeader)) {
+            close(fd);
+            throw std::runtime_error("Mesh Load Error: Truncated binary mesh " + path);
+        }
+        this->size = (size_t)status.st_size;
+
+        void* mapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Mesh Load Error: Cannot map " + path);
+        }
+        this->data = (const char*)mapped;
+#endif
+        this->header = reinterpret_cast<const BinaryMeshHeader*>(this->data);
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (this->data != nullptr) UnmapViewOfFile(this->data);
+        if (this->mapping != nullptr) CloseHandle(this->mapping);
+        if (this->file != INVALID_HANDLE_VALUE) CloseHandle(this->file);
+        this->mapping = nullptr;
+        this->file = INVALID_HANDLE_VALUE;
+#else
+        if (this->data != nullptr) munmap((void*)this->data, this->size);
+#endif
+        this->data = nullptr;
+        this->header = nullptr;
+    }
+
+    void validate(const std::string& path, bool validateIndices) {
+        const BinaryMeshHeader& h = *this->header;
+        if (this->size < sizeof(BinaryMeshHeader) || std::memcmp(h.magic, BINARY_MESH_MAGIC, sizeof(h.magic)) != 0) {
+            throw std::runtime_error("Mesh Load Error: Not a binary mesh: " + path);
+        }
+        if (h.version == byteSwapped(BINARY_MESH_VERSION)) {
+            throw std::runtime_error("Mesh Load Error: Binary mesh written with the other byte order: " + path);
+        }
+        if (h.version != BINARY_MESH_VERSION) {
+            throw std::runtime_error("Mesh Load Error: Unsupported binary mesh version " + std::to_string(h.version) + " in " + path);
+        }
+
+        // Offsets come straight from the file, so they are ordered first and each section is measured
+        // against the room up to the next one; adding sizes to them could wrap around
+        size_t indexSize = (h.flags & BINARY_MESH_SHORT_INDICES) ? 2 : 4;
+        bool isValid = h.vertexCount > 0 && h.triangleCount > 0 && h.vertexCount <= 0x7FFFFFFF
+                    && h.vertexStride == paddedLength(h.vertexCount) && h.normalStride == paddedLength(h.triangleCount)
+                    && h.vertexOffset % BINARY_MESH_ALIGNMENT == 0 && h.normalOffset % BINARY_MESH_ALIGNMENT == 0
+                    && h.indexOffset % BINARY_MESH_ALIGNMENT == 0 && h.fileSize == this->size
+                    && sizeof(BinaryMeshHeader) <= h.vertexOffset && h.vertexOffset <= h.normalOffset
+                    && h.normalOffset <= h.indexOffset && h.indexOffset <= h.fileSize
+                    && 3ULL * h.vertexStride * sizeof(float) <= h.normalOffset - h.vertexOffset
+                    && 3ULL * h.normalStride * sizeof(float) <= h.indexOffset - h.normalOffset
+                    && 3ULL * h.triangleCount * indexSize <= h.fileSize - h.indexOffset;
+        if (!isValid) {
+            throw std::runtime_error("Mesh Load Error: Corrupt binary mesh header in " + path);
+        }
+
+        size_t indexCount = 3 * (size_t)h.triangleCount;
+        if (indexSize == 2) {
+            const uint16_t* indices = reinterpret_cast<const uint16_t*>(this->data + h.indexOffset);
+            this->widenedIndices.assign(indices, indices + indexCount);
+        }
+
+        if (validateIndices) {
+            const int* indices = triangles();
+            for (size_t i = 0; i < indexCount; i++) {
+                if ((uint32_t)indices[i] >= h.vertexCount) {
+                    throw std::runtime_error("Mesh Load Error: Triangle index out of range in " + path);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+// 32-byte node of a flattened BVH. Inner nodes have count == 0 and their children at leftFirst and
+// leftFirst + 1; leaves cover count triangles starting at leftFirst in Bvh::order().
+struct BvhNode {
+    float minX, minY, minZ;
+    uint32_t leftFirst;
+    float maxX, maxY, maxZ;
+    uint32_t count;
+
+    bool isLeaf() const {
+        return this->count > 0;
+    }
+};
+
+// Bounding volume hierarchy over a triangle mesh in model space, built with binned SAH splits.
+// The top levels are split on the calling thread until there is a subtree per job, then the
+// subtrees are built in parallel and appended depth first, so children always sit next to each other.
+class Bvh {
+public:
+    static constexpr unsigned int MAX_LEAF_SIZE = 32;
+    static constexpr unsigned int BIN_COUNT = 16;
+
+private:
+    std::vector<BvhNode> nodes;
+
+    // Triangles under each node, leaves included
+    std::vector<uint32_t> subtreeTriangles;
+
+    // Triangle ids in leaf order, and their vertex indices copied in the same order
+    std::vector<int> triangleOrder;
+    std::vector<int> orderedTriangles;
+
+    // Nodes on the longest path from the root to a leaf
+    unsigned int levels = 0;
+
+    // One per triangle while building; partitioned in place so every pass reads memory in order
+    struct BuildRecord {
+        float lo[3];
+        float hi[3];
+        float centroid[3];
+        int triangle;
+    };
+    std::vector<BuildRecord> records;
+
+    // A run of records, with the bounds of their centroids
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+        float centroidLo[3];
+        float centroidHi[3];
+    };
+
+    struct Subtree {
+        uint32_t node;
+        Range range;
+    };
+
+public:
+    bool empty() const {
+        return this->nodes.empty();
+    }
+
+    const std::vector<BvhNode>& getNodes() const {
+        return this->nodes;
+    }
+
+    unsigned int height() const {
+        return this->levels;
+    }
+
+    uint32_t triangleCount(uint32_t node) const {
+        return this->subtreeTriangles[node];
+    }
+
+    const std::vector<int>& order() const {
+        return this->triangleOrder;
+    }
+
+    // Vertex indices of the triangle at position i of order(): triangles()[3 * i .. 3 * i + 2]
+    const std::vector<int>& triangles() const {
+        return this->orderedTriangles;
+    }
+
+    void clear() {
+        this->nodes.clear();
+        this->subtreeTriangles.clear();
+        this->triangleOrder.clear();
+        this->orderedTriangles.clear();
+        this->levels = 0;
+    }
+
+    // pool may be null for a single-threaded build
+    void build(const SoAVertexBuffer& vertices, const int* triangles, unsigned int triangleCount, ThreadPool* pool = nullptr) {
+        clear();
+        if (triangleCount == 0) {
+            return;
+        }
+
+        const float* stream[3] = { vertices.x, vertices.y, vertices.z };
+        this->records.resize(triangleCount);
+
+        size_t chunkSize = 4096;
+        size_t chunkCount = (triangleCount + chunkSize - 1) / chunkSize;
+        forEach(pool, chunkCount, [&](size_t chunk) {
+            size_t end = std::min((size_t)triangleCount, (chunk + 1) * chunkSize);
+            for (size_t t = chunk * chunkSize; t < end; t++) {
+                BuildRecord& record = this->records[t];
+                int i0 = triangles[3 * t], i1 = triangles[3 * t + 1], i2 = triangles[3 * t + 2];
+                for (int axis = 0; axis < 3; axis++) {
+                    float a = stream[axis][i0], b = stream[axis][i1], c = stream[axis][i2];
+                    record.lo[axis] = std::min(a, std::min(b, c));
+                    record.hi[axis] = std::max(a, std::max(b, c));
+                    record.centroid[axis] = (record.lo[axis] + record.hi[axis]) * 0.5f;
+                }
+                record.triangle = (int)t;
+            }
+        });
+
+        // Split breadth first until every job has a subtree to build
+        Range root = { 0, triangleCount, {}, {} };
+        BvhNode rootNode;
+        bound(root, rootNode);
+
+        size_t targetSubtrees = pool ? 4 * (size_t)pool->size() : 1;
+        this->nodes.assign(1, rootNode);
+        std::vector<Subtree> pending = { { 0, root } };
+        std::vector<Subtree> subtrees;
+
+        for (size_t next = 0; next < pending.size(); next++) {
+            Subtree subtree = pending[next];
+            if (pending.size() - next + subtrees.size() >= targetSubtrees) {
+                subtrees.push_back(subtree);
+                continue;
+            }
+
+            BvhNode left, right;
+            Range leftRange, rightRange;
+            if (!split(subtree.range, left, right, leftRange, rightRange)) {
+                makeLeaf(this->nodes[subtree.node], subtree.range);
+                continue;
+            }
+
+            uint32_t leftIndex = (uint32_t)this->nodes.size();
+            this->nodes[subtree.node].leftFirst = leftIndex;
+            this->nodes[subtree.node].count = 0;
+            this->nodes.push_back(left);
+            this->nodes.push_back(right);
+            pending.push_back({ leftIndex, leftRange });
+            pending.push_back({ leftIndex + 1, rightRange });
+        }
+
+        std::vector<std::vector<BvhNode>> local(subtrees.size());
+        forEach(pool, subtrees.size(), [&](size_t i) {
+            local[i].reserve(4 * subtrees[i].range.count / MAX_LEAF_SIZE + 1);
+            local[i].assign(1, this->nodes[subtrees[i].node]);
+            buildRecursive(local[i], 0, subtrees[i].range);
+        });
+
+        // Each local root replaces its placeholder; the rest is appended with child indices rebased
+        for (size_t i = 0; i < subtrees.size(); i++) {
+            uint32_t base = (uint32_t)this->nodes.size() - 1;
+            for (size_t n = 0; n < local[i].size(); n++) {
+                BvhNode node = local[i][n];
+                if (!node.isLeaf()) {
+                    node.leftFirst += base;
+                }
+                if (n == 0) {
+                    this->nodes[subtrees[i].node] = node;
+                } else {
+                    this->nodes.push_back(node);
+                }
+            }
+        }
+
+        // Children always come after their parent, so one backwards pass sums every subtree
+        this->subtreeTriangles.resize(this->nodes.size());
+        for (size_t n = this->nodes.size(); n-- > 0;) {
+            const BvhNode& node = this->nodes[n];
+            this->subtreeTriangles[n] = node.isLeaf() ? node.count
+                                      : this->subtreeTriangles[node.leftFirst] + this->subtreeTriangles[node.leftFirst + 1];
+        }
+
+        // And a forward pass finds the deepest leaf
+        std::vector<unsigned int> depths(this->nodes.size(), 1);
+        this->levels = 1;
+        for (size_t n = 0; n < this->nodes.size(); n++) {
+            const BvhNode& node = this->nodes[n];
+            if (!node.isLeaf()) {
+                depths[node.leftFirst] = depths[node.leftFirst + 1] = depths[n] + 1;
+                this->levels = std::max(this->levels, depths[n] + 1);
+            }
+        }
+
+        this->triangleOrder.resize(triangleCount);
+        this->orderedTriangles.resize(3 * (size_t)triangleCount);
+        forEach(pool, chunkCount, [&](size_t chunk) {
+            size_t end = std::min((size_t)triangleCount, (chunk + 1) * chunkSize);
+            for (size_t t = chunk * chunkSize; t < end; t++) {
+                int triangle = this->records[t].triangle;
+                this->triangleOrder[t] = triangle;
+                std::copy(&triangles[3 * (size_t)triangle], &triangles[3 * (size_t)triangle + 3], &this->orderedTriangles[3 * t]);
+            }
+        });
+
+        std::vector<BuildRecord>().swap(this->records);
+    }
+
+private:
+    static void forEach(ThreadPool* pool, size_t jobCount, const std::function<void(size_t)>& job) {
+        if (pool) {
+            pool->run(jobCount, [&](size_t index, unsigned int) { job(index); });
+        } else {
+            for (size_t i = 0; i < jobCount; i++) {
+                job(i);
+            }
+        }
+    }
+
+    static void makeLeaf(BvhNode& node, const Range& range) {
+        node.leftFirst = range.first;
+        node.count = range.count;
+    }
+
+    // Node bounds and centroid bounds of a range, for the root; splits derive both for their children
+    void bound(Range& range, BvhNode& node) const {
+        Bin bin;
+        for (uint32_t i = range.first; i < range.first + range.count; i++) {
+            bin.add(this->records[i]);
+        }
+        bin.store(node, range);
+    }
+
+    void buildRecursive(std::vector<BvhNode>& local, uint32_t nodeIndex, const Range& range) {
+        BvhNode left, right;
+        Range leftRange, rightRange;
+        if (!split(range, left, right, leftRange, rightRange)) {
+            makeLeaf(local[nodeIndex], range);
+            return;
+        }
+
+        uint32_t leftIndex = (uint32_t)local.size();
+        local[nodeIndex].leftFirst = leftIndex;
+        local[nodeIndex].count = 0;
+        local.push_back(left);
+        local.push_back(right);
+        buildRecursive(local, leftIndex, leftRange);
+        buildRecursive(local, leftIndex + 1, rightRange);
+    }
+
+    static float halfArea(const float* lo, const float* hi) {
+        float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    // Bounds of the triangles and of their centroids
+    struct Bin {
+        float lo[3] = { INFINITY, INFINITY, INFINITY };
+        float hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+        float centroidLo[3] = { INFINITY, INFINITY, INFINITY };
+        float centroidHi[3] = { -INFINITY, -INFINITY, -INFINITY };
+        unsigned int count = 0;
+
+        void add(const BuildRecord& record) {
+            for (int k = 0; k < 3; k++) {
+                this->lo[k] = std::min(this->lo[k], record.lo[k]);
+                this->hi[k] = std::max(this->hi[k], record.hi[k]);
+                this->centroidLo[k] = std::min(this->centroidLo[k], record.centroid[k]);
+                this->centroidHi[k] = std::max(this->centroidHi[k], record.centroid[k]);
+            }
+            this->count++;
+        }
+
+        void add(const Bin& other) {
+            for (int k = 0; k < 3; k++) {
+                this->lo[k] = std::min(this->lo[k], other.lo[k]);
+                this->hi[k] = std::max(this->hi[k], other.hi[k]);
+                this->centroidLo[k] = std::min(this->centroidLo[k], other.centroidLo[k]);
+                this->centroidHi[k] = std::max(this->centroidHi[k], other.centroidHi[k]);
+            }
+            this->count += other.count;
+        }
+
+        void store(BvhNode& node, Range& range) const {
+            node.minX = this->lo[0]; node.minY = this->lo[1]; node.minZ = this->lo[2];
+            node.maxX = this->hi[0]; node.maxY = this->hi[1]; node.maxZ = this->hi[2];
+            node.leftFirst = 0;
+            node.count = 0;
+            std::copy(this->centroidLo, this->centroidLo + 3, range.centroidLo);
+            std::copy(this->centroidHi, this->centroidHi + 3, range.centroidHi);
+        }
+    };
+
+    // Bins the range along its widest centroid axis and partitions it at the cheapest SAH plane.
+    // Returns false for a leaf, which is every range of at most MAX_LEAF_SIZE triangles and no other;
+    // otherwise fills in both children and their ranges. Ranges SAH cannot split, their centroids
+    // all falling into one bin, are split at the median centroid.
+    bool split(const Range& range, BvhNode& left, BvhNode& right, Range& leftRange, Range& rightRange) {
+        if (range.count <= MAX_LEAF_SIZE) {
+            return false;
+        }
+
+        int axis = 0;
+        for (int k = 1; k < 3; k++) {
+            if (range.centroidHi[k] - range.centroidLo[k] > range.centroidHi[axis] - range.centroidLo[axis]) {
+                axis = k;
+            }
+        }
+
+        float axisLo = range.centroidLo[axis];
+        float extent = range.centroidHi[axis] - axisLo;
+        if (extent <= 0) {
+            // Every centroid coincides, so any order is a median order
+            splitInHalf(range, -1, left, right, leftRange, rightRange);
+            return true;
+        }
+
+        float scale = BIN_COUNT / extent;
+        Bin bins[BIN_COUNT];
+        for (uint32_t i = range.first; i < range.first + range.count; i++) {
+            bins[binOf(this->records[i].centroid[axis], axisLo, scale)].add(this->records[i]);
+        }
+
+        // Sweep from the right, then evaluate every plane while sweeping from the left
+        Bin rightBins[BIN_COUNT];
+        for (int b = BIN_COUNT - 1; b > 0; b--) {
+            rightBins[b] = bins[b];
+            if (b + 1 < (int)BIN_COUNT) {
+                rightBins[b].add(rightBins[b + 1]);
+            }
+        }
+
+        float bestCost = INFINITY;
+        unsigned int bestBin = 0;
+        Bin leftBin, bestLeft;
+        for (unsigned int b = 0; b + 1 < BIN_COUNT; b++) {
+            leftBin.add(bins[b]);
+            if (leftBin.count == 0 || rightBins[b + 1].count == 0) {
+                continue;
+            }
+
+            float cost = leftBin.count * halfArea(leftBin.lo, leftBin.hi) + rightBins[b + 1].count * halfArea(rightBins[b + 1].lo, rightBins[b + 1].hi);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestBin = b + 1;
+                bestLeft = leftBin;
+            }
+        }
+
+        if (bestBin == 0) {
+            splitInHalf(range, axis, left, right, leftRange, rightRange);
+            return true;
+        }
+
+        BuildRecord* begin = &this->records[range.first];
+        std::partition(begin, begin + range.count, [&](const BuildRecord& record) {
+            return binOf(record.centroid[axis], axisLo, scale) < bestBin;
+        });
+
+        leftRange.first = range.first;
+        leftRange.count = bestLeft.count;
+        rightRange.first = range.first + bestLeft.count;
+        rightRange.count = range.count - bestLeft.count;
+        bestLeft.store(left, leftRange);
+        rightBins[bestBin].store(right, rightRange);
+        return true;
+    }
+
+    // Splits the range into halves, ordered by centroid along axis first unless axis is -1
+    void splitInHalf(const Range& range, int axis, BvhNode& left, BvhNode& right, Range& leftRange, Range& rightRange) {
+        BuildRecord* begin = &this->records[range.first];
+        if (axis >= 0) {
+            std::nth_element(begin, begin + range.count / 2, begin + range.count, [axis](const BuildRecord& a, const BuildRecord& b) {
+                return a.centroid[axis] < b.centroid[axis];
+            });
+        }
+        leftRange.first = range.first;
+        leftRange.count = range.count / 2;
+        rightRange.first = range.first + leftRange.count;
+        rightRange.count = range.count - leftRange.count;
+        bound(leftRange, left);
+        bound(rightRange, right);
+    }
+
+    // Clamped before the cast, which is undefined for values out of range. Non-finite centroids of
+    // degenerate triangles land in a valid bin too: std::max(0.0f, NaN) is 0.
+    static unsigned int binOf(float centroid, float lo, float scale) {
+        return (unsigned int)std::min(BIN_COUNT - 1.0f, std::max(0.0f, (centroid - lo) * scale));
+    }
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+const int COARSE_BLOCK_WIDTH = 8;
+const int COARSE_BLOCK_HEIGHT = 4;
+
+// Cell writes a block takes before its farthest bound is worth recomputing from its cells. Each
+// recomputation that fails to prove the block hidden doubles the count, up to the maximum.
+const unsigned int COARSE_REFRESH_WRITES = 8;
+const unsigned int COARSE_REFRESH_WRITES_MAX = 64;
+
+// Conservative per-block bounds of a 1/z buffer, where larger means nearer and writes only ever
+// increase a cell. farthest never exceeds the smallest 1/z in its block and nearest never falls
+// below the largest, so whole triangles or blocks can be rejected, or accepted without per-cell
+// depth tests, before any cell is visited. Writes only make the bounds looser; a loose farthest
+// bound is tightened from the cells when a test fails on it after enough writes to pay for the scan.
+class CoarseDepthBuffer {
+private:
+    const float* depthBuffer = nullptr;
+    int originX = 0;
+    int originY = 0;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+
+    int blocksX = 0;
+    int blocksY = 0;
+    std::vector<float> farthest;
+    std::vector<float> nearest;
+    std::vector<unsigned int> pendingWrites;
+    std::vector<unsigned int> refreshWrites;
+
+public:
+    // Rejections since the last call to resetCounters()
+    unsigned long long rejectedTriangles = 0;
+    unsigned long long rejectedBlocks = 0;
+
+    // Covers the width x height cells whose top-left cell is (originX, originY), a multiple of the
+    // block size; cell (x, y) lives at (x - originX) + (y - originY) * stride of depthBuffer
+    void attach(const float* depthBuffer, int originX, int originY, int width, int height, int stride) {
+        this->depthBuffer = depthBuffer;
+        this->originX = originX;
+        this->originY = originY;
+        this->width = width;
+        this->height = height;
+        this->stride = stride;
+
+        this->blocksX = (width + COARSE_BLOCK_WIDTH - 1) / COARSE_BLOCK_WIDTH;
+        this->blocksY = (height + COARSE_BLOCK_HEIGHT - 1) / COARSE_BLOCK_HEIGHT;
+        size_t blockCount = (size_t)this->blocksX * this->blocksY;
+        this->farthest.assign(blockCount, 0);
+        this->nearest.assign(blockCount, INFINITY);
+        this->pendingWrites.assign(blockCount, COARSE_REFRESH_WRITES);
+        this->refreshWrites.assign(blockCount, COARSE_REFRESH_WRITES);
+    }
+
+    // Every cell has just been set to ooz
+    void clear(float ooz) {
+        std::fill(this->farthest.begin(), this->farthest.end(), ooz);
+        std::fill(this->nearest.begin(), this->nearest.end(), ooz);
+        std::fill(this->pendingWrites.begin(), this->pendingWrites.end(), 0);
+        std::fill(this->refreshWrites.begin(), this->refreshWrites.end(), COARSE_REFRESH_WRITES);
+    }
+
+    void resetCounters() {
+        this->rejectedTriangles = 0;
+        this->rejectedBlocks = 0;
+    }
+
+    int blockOf(int x, int y) const {
+        return (x - this->originX) / COARSE_BLOCK_WIDTH + (y - this->originY) / COARSE_BLOCK_HEIGHT * this->blocksX;
+    }
+
+    // cells cells of the block were written with a 1/z of at most ooz
+    void written(int block, float ooz, unsigned int cells = 1) {
+        this->nearest[block] = std::max(this->nearest[block], ooz);
+        this->pendingWrites[block] += cells;
+    }
+
+    // Cells of the block-aligned area [x, x + width) x [y, y + height) were overwritten by nearer values
+    void invalidate(int x, int y, int width, int height) {
+        for (int blockY = y; blockY < y + height; blockY += COARSE_BLOCK_HEIGHT) {
+            for (int blockX = x; blockX < x + width; blockX += COARSE_BLOCK_WIDTH) {
+                int block = blockOf(blockX, blockY);
+                written(block, INFINITY, this->refreshWrites[block]);
+            }
+        }
+    }
+
+    // True when every cell of the block is at least as near as ooz
+    bool isBlockOccluded(int block, float ooz) {
+        if (this->farthest[block] >= ooz) {
+            return true;
+        }
+        // No cell is nearer than the nearest bound, so a refresh could not help
+        if (this->nearest[block] < ooz) {
+            return false;
+        }
+        if (this->pendingWrites[block] >= this->refreshWrites[block]) {
+            refresh(block);
+            if (this->farthest[block] >= ooz) {
+                this->refreshWrites[block] = COARSE_REFRESH_WRITES;
+                return true;
+            }
+            this->refreshWrites[block] = std::min(2 * this->refreshWrites[block], COARSE_REFRESH_WRITES_MAX);
+        }
+        return false;
+    }
+
+    // True when every cell of the block is farther than ooz
+    bool isBlockBehind(int block, float ooz) const {
+        return this->nearest[block] < ooz;
+    }
+
+    // True when every cell of [minX, maxX] x [minY, maxY], clamped to the covered area, is at least as near as ooz.
+    // Blocks whose bounds cannot decide are resolved from the cells they share with the rectangle.
+    bool isOccluded(int minX, int maxX, int minY, int maxY, float ooz) {
+        minX = std::max(minX, this->originX);
+        minY = std::max(minY, this->originY);
+        maxX = std::min(maxX, this->originX + this->width - 1);
+        maxY = std::min(maxY, this->originY + this->height - 1);
+
+        for (int blockY = minY - (minY - this->originY) % COARSE_BLOCK_HEIGHT; blockY <= maxY; blockY += COARSE_BLOCK_HEIGHT) {
+            for (int blockX = minX - (minX - this->originX) % COARSE_BLOCK_WIDTH; blockX <= maxX; blockX += COARSE_BLOCK_WIDTH) {
+                if (isBlockOccluded(blockOf(blockX, blockY), ooz)) {
+                    continue;
+                }
+
+                int endY = std::min(maxY, blockY + COARSE_BLOCK_HEIGHT - 1);
+                int endX = std::min(maxX, blockX + COARSE_BLOCK_WIDTH - 1);
+                for (int y = std::max(minY, blockY); y <= endY; y++) {
+                    const float* row = this->depthBuffer + (y - this->originY) * this->stride - this->originX;
+                    for (int x = std::max(minX, blockX); x <= endX; x++) {
+                        if (row[x] < ooz) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    void refresh(int block) {
+        int blockX = this->originX + block % this->blocksX * COARSE_BLOCK_WIDTH;
+        int blockY = this->originY + block / this->blocksX * COARSE_BLOCK_HEIGHT;
+        int endX = std::min(blockX + COARSE_BLOCK_WIDTH, this->originX + this->width);
+        int endY = std::min(blockY + COARSE_BLOCK_HEIGHT, this->originY + this->height);
+
+        float lo = INFINITY, hi = -INFINITY;
+        for (int y = blockY; y < endY; y++) {
+            const float* row = this->depthBuffer + (y - this->originY) * this->stride - this->originX;
+            for (int x = blockX; x < endX; x++) {
+                lo = std::min(lo, row[x]);
+                hi = std::max(hi, row[x]);
+            }
+        }
+        this->farthest[block] = lo;
+        this->nearest[block] = hi;
+        this->pendingWrites[block] = 0;
+    }
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Everything a cached frame depends on besides the scene itself, quantized or bit for bit
+struct PoseKey {
+    static constexpr int FIELDS = 13;
+    int32_t fields[FIELDS] = {};
+
+    bool operator==(const PoseKey& other) const {
+        return std::memcmp(this->fields, other.fields, sizeof(this->fields)) == 0;
+    }
+};
+
+struct PoseKeyHash {
+    size_t operator()(const PoseKey& key) const {
+        // FNV-1a over the fields
+        uint64_t hash = 1469598103934665603ull;
+        for (int32_t field : key.fields) {
+            for (int b = 0; b < 4; b++) {
+                hash = (hash ^ (uint8_t)(field >> (8 * b))) * 1099511628211ull;
+            }
+        }
+        return (size_t)hash;
+    }
+};
+
+struct FrameCacheStats {
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    unsigned long long evictions = 0;
+
+    size_t frames = 0;
+
+    // Compressed frames plus bookkeeping, as counted against the budget
+    size_t bytes = 0;
+};
+
+// Finished character frames by pose, run-length compressed and bounded by a byte budget, the least
+// recently used going first. Poses closer than angleStep radians and translationStep units share a
+// frame. Safe to share between threads, e.g. with a renderer filling it in the background.
+class FrameCache {
+public:
+    // Counted for every frame on top of its compressed size
+    static constexpr size_t ENTRY_OVERHEAD = 96;
+
+private:
+    struct Entry {
+        PoseKey key;
+        unsigned int area;
+        bool hasMaterials;
+
+        // The characters, then the materials if any, as (length, value) pairs
+        std::vector<unsigned char> runs;
+    };
+
+    size_t maxBytes;
+    float angleStep;
+    float translationStep;
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries;
+    std::unordered_map<PoseKey, std::list<Entry>::iterator, PoseKeyHash> index;
+    FrameCacheStats counters;
+
+public:
+    FrameCache(size_t maxBytes, float angleStep = 0.005f, float translationStep = 0.005f)
+        : maxBytes(maxBytes), angleStep(angleStep), translationStep(translationStep) {
+        if (maxBytes == 0) {
+            throw std::invalid_argument("FrameCache Error: Invalid budget!");
+        }
+        if (!(angleStep > 0) || !(translationStep > 0)) {
+            throw std::invalid_argument("FrameCache Error: Invalid quantization step!");
+        }
+    }
+
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    // Bucket of an angle, the same for every turn around the circle
+    int32_t quantizeAngle(float angle) const {
+        const double turn = 2 * M_PI;
+        int32_t buckets = (int32_t)std::lround(turn / this->angleStep);
+        double wrapped = angle - turn * std::floor(angle / turn);
+        int32_t bucket = (int32_t)std::lround(wrapped / this->angleStep);
+        return bucket >= buckets ? 0 : bucket;
+    }
+
+    int32_t quantizeLength(float length) const {
+        return (int32_t)std::lround(length / this->translationStep);
+    }
+
+    // The pose a bucket stands for, so every frame stored under a key is drawn from the same pose
+    float snapAngle(float angle) const {
+        return (float)(quantizeAngle(angle) * (double)this->angleStep);
+    }
+
+    float snapLength(float length) const {
+        return (float)(quantizeLength(length) * (double)this->translationStep);
+    }
+
+    // Parameters that must match exactly, such as the light
+    static int32_t exact(float value) {
+        int32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // Copies the frame of key into frame, which holds area cells, and marks it most recently used
+    bool find(const PoseKey& key, char* frame, unsigned int area) {
+        return find(key, frame, nullptr, area);
+    }
+
+    // As find(key, frame, area), also restoring the per-cell materials stored with the frame. Frames
+    // stored with materials only match lookups with materials, and the other way around.
+    bool find(const PoseKey& key, char* frame, unsigned char* materials, unsigned int area) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto found = this->index.find(key);
+        if (found == this->index.end() || found->second->area != area || found->second->hasMaterials != (materials != nullptr)) {
+            this->counters.misses++;
+            return false;
+        }
+
+        this->entries.splice(this->entries.begin(), this->entries, found->second);
+        const std::vector<unsigned char>& runs = found->second->runs;
+        size_t next = decode(runs, 0, (unsigned char*)frame, area);
+        if (materials != nullptr) {
+            decode(runs, next, materials, area);
+        }
+        this->counters.hits++;
+        return true;
+    }
+
+    bool contains(const PoseKey& key) const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->index.count(key) > 0;
+    }
+
+    // Frames larger than the whole budget are not kept
+    void insert(const PoseKey& key, const char* frame, unsigned int area) {
+        insert(key, frame, nullptr, area);
+    }
+
+    void insert(const PoseKey& key, const char* frame, const unsigned char* materials, unsigned int area) {
+        std::vector<unsigned char> runs;
+        encode((const unsigned char*)frame, area, runs);
+        if (materials != nullptr) {
+            encode(materials, area, runs);
+        }
+        if (runs.size() + ENTRY_OVERHEAD > this->maxBytes) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto found = this->index.find(key);
+        if (found != this->index.end()) {
+            remove(found->second);
+        }
+
+        this->counters.bytes += runs.size() + ENTRY_OVERHEAD;
+        this->entries.push_front(Entry{ key, area, materials != nullptr, std::move(runs) });
+        this->index[key] = this->entries.begin();
+        this->counters.frames++;
+
+        while (this->counters.bytes > this->maxBytes) {
+            remove(std::prev(this->entries.end()));
+            this->counters.evictions++;
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->entries.clear();
+        this->index.clear();
+        this->counters.frames = 0;
+        this->counters.bytes = 0;
+    }
+
+    FrameCacheStats getStats() const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->counters;
+    }
+
+private:
+    static void encode(const unsigned char* cells, unsigned int area, std::vector<unsigned char>& runs) {
+        for (unsigned int i = 0; i < area;) {
+            unsigned int length = 1;
+            while (i + length < area && length < 255 && cells[i + length] == cells[i]) {
+                length++;
+            }
+            runs.push_back((unsigned char)length);
+            runs.push_back(cells[i]);
+            i += length;
+        }
+    }
+
+    // Expands area cells starting at runs[first], and returns where the next plane starts
+    static size_t decode(const std::vector<unsigned char>& runs, size_t first, unsigned char* cells, unsigned int area) {
+        size_t i = first;
+        for (unsigned int decoded = 0; decoded < area; i += 2) {
+            std::memset(cells + decoded, runs[i + 1], runs[i]);
+            decoded += runs[i];
+        }
+        return i;
+    }
+
+    void remove(std::list<Entry>::iterator entry) {
+        this->counters.bytes -= entry->runs.size() + ENTRY_OVERHEAD;
+        this->counters.frames--;
+        this->index.erase(entry->key);
+        this->entries.erase(entry);
+    }
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+// Text writes each frame's rows followed by newlines, then an empty line. Raw starts with a header
+// ("VFRM", then width, height and planes as little-endian uint32) followed by the selected planes
+// of every frame back to back: characters, then 1/z as native floats, then light levels.
+enum class FrameFormat {
+    Text,
+    Raw
+};
+
+const unsigned int FRAME_CHARACTERS = 1;
+const unsigned int FRAME_DEPTH = 2;
+const unsigned int FRAME_LIGHT = 4;
+
+// Streams frames of a headless Renderer to a file or pipe, as fast as they are rendered. Files it
+// opens are block buffered, so nothing reaches them before flush(), destruction or a full buffer.
+class FrameWriter {
+public:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+private:
+    FILE* file = nullptr;
+    bool ownsFile = false;
+
+    unsigned int width;
+    unsigned int height;
+    FrameFormat format;
+    unsigned int planes;
+
+    std::vector<char> buffer;
+    std::vector<unsigned char> light;
+
+    unsigned long long frameCount = 0;
+    unsigned long long byteCount = 0;
+
+public:
+    // "-" writes to standard output, with the buffering it already has
+    FrameWriter(const std::string& path, unsigned int width, unsigned int height,
+                FrameFormat format = FrameFormat::Text, unsigned int planes = FRAME_CHARACTERS)
+        : width(width), height(height), format(format), planes(planes) {
+        validate();
+        if (path == "-") {
+            this->file = stdout;
+        } else {
+            this->file = std::fopen(path.c_str(), "wb");
+            this->ownsFile = true;
+        }
+        if (this->file == nullptr) {
+            throw std::runtime_error("FrameWriter Error: Cannot open " + path + "!");
+        }
+        start();
+    }
+
+    // Writes to a stream the caller opened, e.g. with popen(). It is flushed on destruction but not closed.
+    FrameWriter(FILE* file, unsigned int width, unsigned int height,
+                FrameFormat format = FrameFormat::Text, unsigned int planes = FRAME_CHARACTERS)
+        : file(file), width(width), height(height), format(format), planes(planes) {
+        if (file == nullptr) {
+            throw std::invalid_argument("FrameWriter Error: Invalid file!");
+        }
+        validate();
+        start();
+    }
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    ~FrameWriter() {
+        if (this->ownsFile) {
+            std::fclose(this->file);
+        } else {
+            std::fflush(this->file);
+        }
+    }
+
+    // Planes are width * height cells, row by row. Planes not selected may be nullptr.
+    void write(const char* characters, const float* depths = nullptr, const unsigned char* levels = nullptr) {
+        if ((this->planes & FRAME_CHARACTERS && characters == nullptr) || (this->planes & FRAME_DEPTH && depths == nullptr)
+            || (this->planes & FRAME_LIGHT && levels == nullptr)) {
+            throw std::invalid_argument("FrameWriter Error: Missing frame plane!");
+        }
+
+        size_t area = (size_t)this->width * this->height;
+        if (this->format == FrameFormat::Text) {
+            for (unsigned int y = 0; y < this->height; y++) {
+                put(characters + (size_t)y * this->width, this->width);
+                put("\n", 1);
+            }
+            put("\n", 1);
+        } else {
+            if (this->planes & FRAME_CHARACTERS) {
+                put(characters, area);
+            }
+            if (this->planes & FRAME_DEPTH) {
+                put(depths, area * sizeof(float));
+            }
+            if (this->planes & FRAME_LIGHT) {
+                put(levels, area);
+            }
+        }
+        this->frameCount++;
+    }
+
+    // The renderer's last frame; its size must match the writer's
+    void write(const Renderer& renderer) {
+        if (renderer.getWidth() != this->width || renderer.getHeight() != this->height) {
+            throw std::invalid_argument("FrameWriter Error: Mismatched frame size!");
+        }
+
+        const unsigned char* levels = nullptr;
+        if (this->planes & FRAME_LIGHT) {
+            this->light.resize((size_t)this->width * this->height);
+            renderer.lightPlane(this->light.data());
+            levels = this->light.data();
+        }
+        write(renderer.characterPlane(), renderer.depthPlane(), levels);
+    }
+
+    void flush() {
+        if (std::fflush(this->file) != 0) {
+            throw std::runtime_error("FrameWriter Error: Flush failed!");
+        }
+    }
+
+    unsigned long long frames() const {
+        return this->frameCount;
+    }
+
+    unsigned long long bytes() const {
+        return this->byteCount;
+    }
+
+private:
+    void validate() const {
+        if (this->width == 0 || this->height == 0) {
+            throw std::invalid_argument("FrameWriter Error: Invalid frame size!");
+        }
+        if (this->planes == 0 || this->planes > (FRAME_CHARACTERS | FRAME_DEPTH | FRAME_LIGHT)) {
+            throw std::invalid_argument("FrameWriter Error: Invalid planes!");
+        }
+        if (this->format == FrameFormat::Text && this->planes != FRAME_CHARACTERS) {
+            throw std::invalid_argument("FrameWriter Error: Text frames only hold characters!");
+        }
+    }
+
+    void start() {
+        // Only a freshly opened stream may have its buffer replaced
+        if (this->ownsFile) {
+            this->buffer.resize(BUFFER_SIZE);
+            std::setvbuf(this->file, this->buffer.data(), _IOFBF, this->buffer.size());
+        }
+
+        if (this->format == FrameFormat::Raw) {
+            uint32_t fields[3] = { this->width, this->height, this->planes };
+            unsigned char header[16] = { 'V', 'F', 'R', 'M' };
+            for (int i = 0; i < 3; i++) {
+                for (int b = 0; b < 4; b++) {
+                    header[4 + 4 * i + b] = (unsigned char)(fields[i] >> (8 * b));
+                }
+            }
+            put(header, sizeof(header));
+        }
+    }
+
+    void put(const void* data, size_t size) {
+        if (std::fwrite(data, 1, size, this->file) != size) {
+            throw std::runtime_error("FrameWriter Error: Write failed!");
+        }
+        this->byteCount += size;
+    }
+};
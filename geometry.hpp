@@ -1,8 +1,10 @@
 #pragma once
 
 #include <math.h>
+#include <cstddef>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 
 template <typename T>
 class Vec3 {
@@ -264,4 +266,423 @@ template <typename T>
 std::ostream& operator<<(std::ostream& os, Triangle<T>& Triangle) {
     os << "P(x): " << Triangle.normal.x << "x + " << Triangle.normal.y << "y + " << Triangle.normal.z << "z + " << Triangle.D;
     return os;
-}
\ No newline at end of file
+}
+
+// Row-major 3x3 matrix acting on column vectors: v' = M * v
+template <typename T>
+class Mat3 {
+public:
+    T m[3][3];
+
+    Mat3() : Mat3(1, 0, 0, 0, 1, 0, 0, 0, 1) {}
+
+    Mat3(T m00, T m01, T m02,
+         T m10, T m11, T m12,
+         T m20, T m21, T m22) {
+        m[0][0] = m00; m[0][1] = m01; m[0][2] = m02;
+        m[1][0] = m10; m[1][1] = m11; m[1][2] = m12;
+        m[2][0] = m20; m[2][1] = m21; m[2][2] = m22;
+    }
+
+    static Mat3<T> identity() {
+        return Mat3<T>();
+    }
+
+    static Mat3<T> rotationX(T theta) {
+        T s = sin(theta), c = cos(theta);
+        return Mat3<T>(1, 0, 0,
+                       0, c, -s,
+                       0, s, c);
+    }
+
+    static Mat3<T> rotationY(T theta) {
+        T s = sin(theta), c = cos(theta);
+        return Mat3<T>(c, 0, s,
+                       0, 1, 0,
+                       -s, 0, c);
+    }
+
+    static Mat3<T> rotationZ(T theta) {
+        T s = sin(theta), c = cos(theta);
+        return Mat3<T>(c, -s, 0,
+                       s, c, 0,
+                       0, 0, 1);
+    }
+
+    // Same convention as Vec3::rotate: Rz * Ry * Rx, built with six trig calls
+    static Mat3<T> rotation(T thetaX, T thetaY, T thetaZ) {
+        T sinX = sin(thetaX), cosX = cos(thetaX);
+        T sinY = sin(thetaY), cosY = cos(thetaY);
+        T sinZ = sin(thetaZ), cosZ = cos(thetaZ);
+
+        return Mat3<T>(cosY * cosZ, cosZ * sinY * sinX - sinZ * cosX, cosZ * sinY * cosX + sinZ * sinX,
+                       cosY * sinZ, sinZ * sinY * sinX + cosZ * cosX, sinZ * sinY * cosX - cosZ * sinX,
+                       -sinY,       cosY * sinX,                      cosY * cosX);
+    }
+
+    static Mat3<T> scale(const Vec3<T>& factor) {
+        return Mat3<T>(factor.x, 0, 0,
+                       0, factor.y, 0,
+                       0, 0, factor.z);
+    }
+
+    Mat3<T> operator*(const Mat3<T>& other) const {
+        Mat3<T> result;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                result.m[r][c] = m[r][0] * other.m[0][c] + m[r][1] * other.m[1][c] + m[r][2] * other.m[2][c];
+            }
+        }
+        return result;
+    }
+
+    Mat3<T>& operator*=(const Mat3<T>& other) {
+        *this = *this * other;
+        return *this;
+    }
+
+    Vec3<T> operator*(const Vec3<T>& v) const {
+        return Vec3<T>(
+            m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+            m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+            m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    Mat3<T> transpose() const {
+        return Mat3<T>(m[0][0], m[1][0], m[2][0],
+                       m[0][1], m[1][1], m[2][1],
+                       m[0][2], m[1][2], m[2][2]);
+    }
+
+    T determinant() const {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+             - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+             + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    Mat3<T> inverse() const {
+        T det = determinant();
+        if (det == 0) {
+            throw std::runtime_error("Matrix inverse error: Singular 3x3 matrix");
+        }
+        T invDet = 1 / det;
+
+        return Mat3<T>(
+            (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * invDet,
+            (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet,
+            (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet,
+            (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * invDet,
+            (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet,
+            (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet,
+            (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * invDet,
+            (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet,
+            (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet);
+    }
+
+    // Transforms n vectors; in and out may be the same array
+    void transformPoints(const Vec3<T>* in, Vec3<T>* out, size_t n) const {
+        const T m00 = m[0][0], m01 = m[0][1], m02 = m[0][2];
+        const T m10 = m[1][0], m11 = m[1][1], m12 = m[1][2];
+        const T m20 = m[2][0], m21 = m[2][1], m22 = m[2][2];
+
+        for (size_t i = 0; i < n; i++) {
+            T x = in[i].x, y = in[i].y, z = in[i].z;
+            out[i].x = m00 * x + m01 * y + m02 * z;
+            out[i].y = m10 * x + m11 * y + m12 * z;
+            out[i].z = m20 * x + m21 * y + m22 * z;
+        }
+    }
+};
+
+// Row-major 4x4 matrix acting on column vectors (x, y, z, 1)
+template <typename T>
+class Mat4 {
+public:
+    T m[4][4];
+
+    Mat4() {
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) {
+                m[r][c] = (r == c) ? 1 : 0;
+            }
+        }
+    }
+
+    // Affine matrix from a linear part and a translation
+    Mat4(const Mat3<T>& linear, const Vec3<T>& translation = Vec3<T>()) : Mat4() {
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                m[r][c] = linear.m[r][c];
+            }
+        }
+        m[0][3] = translation.x;
+        m[1][3] = translation.y;
+        m[2][3] = translation.z;
+    }
+
+    static Mat4<T> identity() {
+        return Mat4<T>();
+    }
+
+    static Mat4<T> translation(const Vec3<T>& offset) {
+        return Mat4<T>(Mat3<T>(), offset);
+    }
+
+    static Mat4<T> scale(const Vec3<T>& factor) {
+        return Mat4<T>(Mat3<T>::scale(factor));
+    }
+
+    static Mat4<T> rotation(T thetaX, T thetaY, T thetaZ) {
+        return Mat4<T>(Mat3<T>::rotation(thetaX, thetaY, thetaZ));
+    }
+
+    static Mat4<T> rotation(const Mat3<T>& rotation) {
+        return Mat4<T>(rotation);
+    }
+
+    // Terminal projection used by Renderer: after the divide by w = z + distanceFromCam,
+    // x and y are screen cells and z is 1 / (z + distanceFromCam).
+    static Mat4<T> screenProjection(T centerX, T centerY, T horizontalScale, T verticalScale, T distanceFromCam) {
+        Mat4<T> result;
+        result.m[0][0] = horizontalScale; result.m[0][1] = 0;              result.m[0][2] = centerX; result.m[0][3] = centerX * distanceFromCam;
+        result.m[1][0] = 0;               result.m[1][1] = -verticalScale; result.m[1][2] = centerY; result.m[1][3] = centerY * distanceFromCam;
+        result.m[2][0] = 0;               result.m[2][1] = 0;              result.m[2][2] = 0;       result.m[2][3] = 1;
+        result.m[3][0] = 0;               result.m[3][1] = 0;              result.m[3][2] = 1;       result.m[3][3] = distanceFromCam;
+        return result;
+    }
+
+    Mat3<T> linear() const {
+        return Mat3<T>(m[0][0], m[0][1], m[0][2],
+                       m[1][0], m[1][1], m[1][2],
+                       m[2][0], m[2][1], m[2][2]);
+    }
+
+    Vec3<T> translationPart() const {
+        return Vec3<T>(m[0][3], m[1][3], m[2][3]);
+    }
+
+    // Inverse-transpose of the linear part, for transforming normals
+    Mat3<T> normalMatrix() const {
+        return linear().inverse().transpose();
+    }
+
+    Mat4<T> operator*(const Mat4<T>& other) const {
+        Mat4<T> result;
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) {
+                result.m[r][c] = m[r][0] * other.m[0][c] + m[r][1] * other.m[1][c] 
+                               + m[r][2] * other.m[2][c] + m[r][3] * other.m[3][c];
+            }
+        }
+        return result;
+    }
+
+    Mat4<T>& operator*=(const Mat4<T>& other) {
+        *this = *this * other;
+        return *this;
+    }
+
+    // Affine transform of a point; the projective row is ignored
+    Vec3<T> operator*(const Vec3<T>& v) const {
+        return Vec3<T>(
+            m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3],
+            m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3],
+            m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3]);
+    }
+
+    Mat4<T> transpose() const {
+        Mat4<T> result;
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) {
+                result.m[r][c] = m[c][r];
+            }
+        }
+        return result;
+    }
+
+    // Gauss-Jordan elimination with partial pivoting
+    Mat4<T> inverse() const {
+        T a[4][8];
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) {
+                a[r][c] = m[r][c];
+                a[r][c + 4] = (r == c) ? 1 : 0;
+            }
+        }
+
+        for (int col = 0; col < 4; col++) {
+            int pivot = col;
+            for (int r = col + 1; r < 4; r++) {
+                if (std::abs(a[r][col]) > std::abs(a[pivot][col])) {
+                    pivot = r;
+                }
+            }
+            if (a[pivot][col] == 0) {
+                throw std::runtime_error("Matrix inverse error: Singular 4x4 matrix");
+            }
+            if (pivot != col) {
+                for (int c = 0; c < 8; c++) {
+                    std::swap(a[pivot][c], a[col][c]);
+                }
+            }
+
+            T invPivot = 1 / a[col][col];
+            for (int c = 0; c < 8; c++) {
+                a[col][c] *= invPivot;
+            }
+
+            for (int r = 0; r < 4; r++) {
+                if (r != col && a[r][col] != 0) {
+                    T factor = a[r][col];
+                    for (int c = 0; c < 8; c++) {
+                        a[r][c] -= factor * a[col][c];
+                    }
+                }
+            }
+        }
+
+        Mat4<T> result;
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) {
+                result.m[r][c] = a[r][c + 4];
+            }
+        }
+        return result;
+    }
+
+    // Affine transform of n points, one matrix multiply each; in and out may be the same array
+    void transformPoints(const Vec3<T>* in, Vec3<T>* out, size_t n) const {
+        const T m00 = m[0][0], m01 = m[0][1], m02 = m[0][2], m03 = m[0][3];
+        const T m10 = m[1][0], m11 = m[1][1], m12 = m[1][2], m13 = m[1][3];
+        const T m20 = m[2][0], m21 = m[2][1], m22 = m[2][2], m23 = m[2][3];
+
+        for (size_t i = 0; i < n; i++) {
+            T x = in[i].x, y = in[i].y, z = in[i].z;
+            out[i].x = m00 * x + m01 * y + m02 * z + m03;
+            out[i].y = m10 * x + m11 * y + m12 * z + m13;
+            out[i].z = m20 * x + m21 * y + m22 * z + m23;
+        }
+    }
+
+    // Full projective transform of n points followed by the divide by w.
+    // Points with w <= 0 lie at or behind the eye and are written as (0, 0, 0).
+    void projectPoints(const Vec3<T>* in, Vec3<T>* out, size_t n) const {
+        for (size_t i = 0; i < n; i++) {
+            T x = in[i].x, y = in[i].y, z = in[i].z;
+            T w = m[3][0] * x + m[3][1] * y + m[3][2] * z + m[3][3];
+            if (w <= 0) {
+                out[i] = Vec3<T>(0, 0, 0);
+                continue;
+            }
+            T invW = 1 / w;
+            out[i].x = (m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3]) * invW;
+            out[i].y = (m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3]) * invW;
+            out[i].z = (m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3]) * invW;
+        }
+    }
+};
+
+// Unit quaternion rotation, w + xi + yj + zk
+template <typename T>
+class Quat {
+public:
+    T w, x, y, z;
+
+    Quat(T w = 1, T x = 0, T y = 0, T z = 0) : w(w), x(x), y(y), z(z) {}
+
+    static Quat<T> fromAxisAngle(const Vec3<T>& axis, T angle) {
+        Vec3<T> unit(axis);
+        unit.normalize();
+        T s = sin(angle / 2);
+        return Quat<T>(cos(angle / 2), unit.x * s, unit.y * s, unit.z * s);
+    }
+
+    // Same convention as Vec3::rotate and Mat3::rotation: X first, then Y, then Z
+    static Quat<T> fromEuler(T thetaX, T thetaY, T thetaZ) {
+        return fromAxisAngle(Vec3<T>(0, 0, 1), thetaZ) 
+             * fromAxisAngle(Vec3<T>(0, 1, 0), thetaY) 
+             * fromAxisAngle(Vec3<T>(1, 0, 0), thetaX);
+    }
+
+    T length() const {
+        return std::sqrt(w * w + x * x + y * y + z * z);
+    }
+
+    void normalize() {
+        T len = length();
+        if (len != 0 && len != 1) {
+            w /= len; x /= len; y /= len; z /= len;
+        }
+    }
+
+    Quat<T> conjugate() const {
+        return Quat<T>(w, -x, -y, -z);
+    }
+
+    Quat<T> inverse() const {
+        T lengthSquared = w * w + x * x + y * y + z * z;
+        if (lengthSquared == 0) {
+            throw std::runtime_error("Quaternion inverse error: Zero quaternion");
+        }
+        return Quat<T>(w / lengthSquared, -x / lengthSquared, -y / lengthSquared, -z / lengthSquared);
+    }
+
+    // Composition: (a * b) rotates by b first, then by a
+    Quat<T> operator*(const Quat<T>& other) const {
+        return Quat<T>(
+            w * other.w - x * other.x - y * other.y - z * other.z,
+            w * other.x + x * other.w + y * other.z - z * other.y,
+            w * other.y - x * other.z + y * other.w + z * other.x,
+            w * other.z + x * other.y - y * other.x + z * other.w);
+    }
+
+    Quat<T>& operator*=(const Quat<T>& other) {
+        *this = *this * other;
+        return *this;
+    }
+
+    Vec3<T> rotate(const Vec3<T>& v) const {
+        Vec3<T> u(x, y, z);
+        Vec3<T> t = (u ^ v) * (T)2;
+        return v + t * w + (u ^ t);
+    }
+
+    Mat3<T> toMat3() const {
+        T xx = x * x, yy = y * y, zz = z * z;
+        T xy = x * y, xz = x * z, yz = y * z;
+        T wx = w * x, wy = w * y, wz = w * z;
+
+        return Mat3<T>(1 - 2 * (yy + zz), 2 * (xy - wz),     2 * (xz + wy),
+                       2 * (xy + wz),     1 - 2 * (xx + zz), 2 * (yz - wx),
+                       2 * (xz - wy),     2 * (yz + wx),     1 - 2 * (xx + yy));
+    }
+
+    static Quat<T> slerp(const Quat<T>& a, const Quat<T>& b, T t) {
+        T cosHalf = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+        Quat<T> end = b;
+        if (cosHalf < 0) {
+            cosHalf = -cosHalf;
+            end = Quat<T>(-b.w, -b.x, -b.y, -b.z);
+        }
+
+        T wa, wb;
+        if (cosHalf > (T)0.9995) {
+            wa = 1 - t;
+            wb = t;
+        } else {
+            T half = std::acos(cosHalf);
+            T sinHalf = sin(half);
+            wa = sin((1 - t) * half) / sinHalf;
+            wb = sin(t * half) / sinHalf;
+        }
+
+        Quat<T> result(wa * a.w + wb * end.w, wa * a.x + wb * end.x, wa * a.y + wb * end.y, wa * a.z + wb * end.z);
+        result.normalize();
+        return result;
+    }
+
+    // Converts to a matrix once, then costs one matrix multiply per point
+    void transformPoints(const Vec3<T>* in, Vec3<T>* out, size_t n) const {
+        toMat3().transformPoints(in, out, n);
+    }
+};
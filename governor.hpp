@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+// Deadline-based frame pacing on the steady clock. Frame n is due at start + n * period, so time
+// spent rendering comes out of the frame's budget instead of being added to a fixed sleep.
+class FrameGovernor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    float targetFps = 50.0f;
+    Clock::duration framePeriod = std::chrono::milliseconds(20);
+    bool isSkipEnabled = false;
+
+    // With frame skipping, a loop further behind than this many frames resynchronizes instead
+    unsigned int maxSkippedFrames = 5;
+
+    bool isStarted = false;
+    Clock::time_point deadline;
+    Clock::time_point lastFrameStart;
+    float lastDeltaSeconds = 0;
+    float totalSeconds = 0;
+
+    unsigned long long frameCount = 0;
+    unsigned long long skippedFrameCount = 0;
+    unsigned long long lateFrameCount = 0;
+
+public:
+    FrameGovernor() {}
+
+    FrameGovernor(float targetFps, bool skipFrames) {
+        target(targetFps, skipFrames);
+    }
+
+    void target(float targetFps, bool skipFrames) {
+        if (targetFps <= 0) {
+            throw std::invalid_argument("FrameGovernor Error: Invalid target frame rate!");
+        }
+        this->targetFps = targetFps;
+        this->framePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.0f / targetFps));
+        this->isSkipEnabled = skipFrames;
+        this->isStarted = false;
+    }
+
+    // Starts a frame and returns the seconds elapsed since the previous one started
+    float beginFrame() {
+        Clock::time_point now = Clock::now();
+
+        if (!this->isStarted) {
+            this->isStarted = true;
+            this->deadline = now + this->framePeriod;
+            this->lastFrameStart = now;
+            this->lastDeltaSeconds = 0;
+            return 0;
+        }
+
+        this->lastDeltaSeconds = std::chrono::duration<float>(now - this->lastFrameStart).count();
+        this->totalSeconds += this->lastDeltaSeconds;
+        this->lastFrameStart = now;
+        return this->lastDeltaSeconds;
+    }
+
+    // True when frame skipping is on and this frame's deadline has already passed
+    bool shouldSkip() const {
+        return this->isSkipEnabled && Clock::now() > this->deadline;
+    }
+
+    // Gives up the current frame's slot without presenting it
+    void skipFrame() {
+        this->deadline += this->framePeriod;
+        this->skippedFrameCount++;
+    }
+
+    // Sleeps until the frame's deadline, then moves the deadline one period on
+    void endFrame() {
+        Clock::time_point now = Clock::now();
+        this->frameCount++;
+
+        if (now < this->deadline) {
+            std::this_thread::sleep_until(this->deadline);
+            this->deadline += this->framePeriod;
+            return;
+        }
+
+        this->lateFrameCount++;
+        Clock::duration debt = now - this->deadline;
+        if (!this->isSkipEnabled || debt > this->framePeriod * this->maxSkippedFrames) {
+            // Too far behind to catch up: start counting again from now instead of bursting frames
+            this->deadline = now + this->framePeriod;
+        } else {
+            this->deadline += this->framePeriod;
+        }
+    }
+
+    float getTargetFps() const {
+        return this->targetFps;
+    }
+
+    // Seconds between the starts of the last two frames
+    float deltaSeconds() const {
+        return this->lastDeltaSeconds;
+    }
+
+    // Seconds since the first frame started
+    float elapsedSeconds() const {
+        return this->totalSeconds;
+    }
+
+    unsigned long long frames() const {
+        return this->frameCount;
+    }
+
+    unsigned long long skippedFrames() const {
+        return this->skippedFrameCount;
+    }
+
+    unsigned long long lateFrames() const {
+        return this->lateFrameCount;
+    }
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+
+// Per-frame timers and counters of the Renderer, compiled in only when RENDERER_INSTRUMENTATION is
+// defined before renderer.hpp is included (e.g. -DRENDERER_INSTRUMENTATION). Without it every
+// INSTRUMENT() statement expands to nothing, the Renderer carries no counters and frameStats() stays zero.
+#ifdef RENDERER_INSTRUMENTATION
+#define INSTRUMENT(...) __VA_ARGS__
+const bool IS_INSTRUMENTED = true;
+#else
+#define INSTRUMENT(...)
+const bool IS_INSTRUMENTED = false;
+#endif
+
+#define INSTRUMENT_CONCAT(a, b) a##b
+#define INSTRUMENT_NAME(line) INSTRUMENT_CONCAT(scopedTimer, line)
+
+// An argument or parameter that only exists with instrumentation, appended after the others with
+// its comma, e.g. fill(cells INSTRUMENT_ARG(samples))
+#define INSTRUMENT_ARG(...) INSTRUMENT(, __VA_ARGS__)
+
+// Adds the seconds spent in the rest of the enclosing scope to target
+#define INSTRUMENT_SCOPE(target) INSTRUMENT(ScopedTimer INSTRUMENT_NAME(__LINE__)(target);)
+
+// Seconds spent in each stage of a frame
+struct StageTimes {
+    // Vertex and normal kernels, and picking levels of detail
+    double transform = 0;
+
+    // RasterMode::ScreenSpace culling, clipping and triangle setup, BVH traversal included
+    double setup = 0;
+
+    // Filling cells. RasterMode::ObjectScan culls and scans each triangle in turn, and counts it all here.
+    double rasterize = 0;
+
+    // Composing and writing the frame, or handing it to the presenter thread; 0 when headless
+    double present = 0;
+
+    // The animationDelay sleep, or waiting for the frame governor's deadline; 0 when headless
+    double sleep = 0;
+
+    // Time spent working on the frame, sleep excluded
+    double total() const {
+        return this->transform + this->setup + this->rasterize + this->present;
+    }
+};
+
+// Samples are ObjectScan points projected onto the screen, or cells covered by a ScreenSpace triangle
+struct SampleCounters {
+    // Compared against the z-buffer
+    unsigned long long tested = 0;
+
+    // Nearer than what the z-buffer held
+    unsigned long long depthPassed = 0;
+
+    // Written to the frame; ObjectScan drops unlit samples after the depth test
+    unsigned long long written = 0;
+
+    SampleCounters& operator+=(const SampleCounters& other) {
+        this->tested += other.tested;
+        this->depthPassed += other.depthPassed;
+        this->written += other.written;
+        return *this;
+    }
+};
+
+struct FrameStats {
+    StageTimes times;
+
+    // Triangles of every instance drawn or culled whole, those removed before rasterization, and
+    // those handed to the rasterizer. cullStats() breaks the culled ones down by test.
+    unsigned long long trianglesSubmitted = 0;
+    unsigned long long trianglesCulled = 0;
+    unsigned long long trianglesRasterized = 0;
+
+    SampleCounters samples;
+
+    // Bytes of escape sequences and characters written for the frame; 0 when headless. With
+    // asyncOutput(), those of the last frame the presenter thread wrote.
+    unsigned long long bytesWritten = 0;
+};
+
+class ScopedTimer {
+private:
+    double& target;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(double& target) : target(target), start(std::chrono::steady_clock::now()) {}
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+        this->target += std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start).count();
+    }
+};
@@ -7,9 +7,13 @@
 #include <string>
 #include <thread>
 #include <chrono>
+#include <tuple>
 
-void printLirik() {
-    std::vector<std::tuple<std::string, int, int>> lirik = {
+#include "timeline.hpp"
+
+// Tiap baris: teks, delay setelah baris (ms), delay per huruf (ms)
+const std::vector<std::tuple<std::string, int, int>>& lirikLines() {
+    static const std::vector<std::tuple<std::string, int, int>> lirik = {
         {"It's stuck with you forever....", 1000, 70},
         {"so promise you won't let it go", 1000, 70},
         {"I'll trust the universe", 700, 70}, 
@@ -26,6 +30,13 @@ void printLirik() {
         {"with me?", 1000, 90},
         {"", 400, 0},
     };
+    return lirik;
+}
+
+// Blocks until the last line is printed, sleeping and flushing after every character; scheduleLirik()
+// plays the same lines without blocking
+void printLirik() {
+    const auto& lirik = lirikLines();
 
     // Cetak lirik dengan huruf muncul satu per satu dengan delay yang berbeda
     for (const auto& baris : lirik) {
@@ -41,3 +52,27 @@ void printLirik() {
         std::this_thread::sleep_for(std::chrono::milliseconds(delayBaris)); // Delay setelah baris selesai
     }
 }
+
+// Schedules the lines on the timeline with the timing of printLirik(), each centered on row y until
+// the next one starts, and returns when the last line ends
+double scheduleLirik(Timeline& timeline, double start, unsigned int width, int y, uint32_t rgb = TEXT_COLOR) {
+    const auto& lirik = lirikLines();
+    double time = start;
+    for (size_t i = 0; i < lirik.size(); i++) {
+        const std::string& teks = std::get<0>(lirik[i]);
+        double delayHuruf = std::get<2>(lirik[i]) / 1000.0;
+        double end = time + teks.size() * delayHuruf + std::get<1>(lirik[i]) / 1000.0;
+
+        // Baris kosong hanya jeda; baris sebelumnya tetap terlihat sampai jeda selesai
+        double visibleUntil = end;
+        for (size_t next = i + 1; next < lirik.size() && std::get<0>(lirik[next]).empty(); next++) {
+            visibleUntil += std::get<1>(lirik[next]) / 1000.0;
+        }
+        if (!teks.empty()) {
+            int x = ((int)width - (int)teks.size()) / 2;
+            timeline.text(time, visibleUntil, x, y, teks, delayHuruf, rgb);
+        }
+        time = end;
+    }
+    return time;
+}
@@ -0,0 +1,527 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "geometry.hpp"
+#include "simd.hpp"
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix (Garland & Heckbert).
+// weight is the total weight of the planes that count towards the mean distance.
+struct Quadric {
+    double xx = 0, xy = 0, xz = 0, xw = 0;
+    double yy = 0, yz = 0, yw = 0;
+    double zz = 0, zw = 0;
+    double ww = 0;
+    double weight = 0;
+
+    // a * x + b * y + c * z + d = 0 with (a, b, c) of unit length
+    static Quadric plane(double a, double b, double c, double d, double weight) {
+        Quadric q;
+        q.xx = weight * a * a; q.xy = weight * a * b; q.xz = weight * a * c; q.xw = weight * a * d;
+        q.yy = weight * b * b; q.yz = weight * b * c; q.yw = weight * b * d;
+        q.zz = weight * c * c; q.zw = weight * c * d;
+        q.ww = weight * d * d;
+        q.weight = weight;
+        return q;
+    }
+
+    void add(const Quadric& other) {
+        this->xx += other.xx; this->xy += other.xy; this->xz += other.xz; this->xw += other.xw;
+        this->yy += other.yy; this->yz += other.yz; this->yw += other.yw;
+        this->zz += other.zz; this->zw += other.zw;
+        this->ww += other.ww;
+        this->weight += other.weight;
+    }
+
+    double error(const Vec3<float>& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double value = this->xx * x * x + 2 * this->xy * x * y + 2 * this->xz * x * z + 2 * this->xw * x
+                     + this->yy * y * y + 2 * this->yz * y * z + 2 * this->yw * y
+                     + this->zz * z * z + 2 * this->zw * z
+                     + this->ww;
+        return std::max(0.0, value);
+    }
+
+    // Mean squared distance to the counted planes
+    double meanError(const Vec3<float>& p) const {
+        return this->weight > 0 ? error(p) / this->weight : error(p);
+    }
+};
+
+// Quadric edge collapse over an indexed triangle mesh. Edges are collapsed cheapest first onto
+// whichever of their two ends or midpoint has the least error. Collapses that would flip a face
+// or pinch the surface into a non-manifold edge are refused, and open borders are held in place
+// by planes perpendicular to them.
+class QuadricSimplifier {
+public:
+    static constexpr double BORDER_WEIGHT = 10.0;
+
+private:
+    struct Candidate {
+        double cost;
+        int u, v;
+        unsigned int versionU, versionV;
+        Vec3<float> target;
+
+        bool operator>(const Candidate& other) const {
+            return this->cost > other.cost;
+        }
+    };
+
+    std::vector<Vec3<float>> positions;
+    std::vector<Quadric> quadrics;
+
+    // Collapsed vertices point towards the vertex they were merged into. Every cluster is also a
+    // ring through nextMember, so its triangles can be listed from the original adjacency.
+    std::vector<int> parent;
+    std::vector<int> nextMember;
+    std::vector<unsigned int> versions;
+
+    std::vector<int> indices;
+    std::vector<unsigned char> isDead;
+    unsigned int liveTriangles = 0;
+
+    // Triangles around each original vertex
+    std::vector<unsigned int> adjacencyStart;
+    std::vector<int> adjacency;
+
+    // Edges are pushed unordered during construction and heapified once at the end
+    std::vector<Candidate> heap;
+    bool isHeap = false;
+    double maxCost = 0;
+
+    std::vector<int> trianglesU, trianglesV, neighborsU, neighborsV;
+
+public:
+    QuadricSimplifier(const Vec3<float>* vertices, size_t vertexCount, const int* triangles, unsigned int triangleCount)
+        : positions(vertices, vertices + vertexCount), quadrics(vertexCount), parent(vertexCount), nextMember(vertexCount),
+          versions(vertexCount, 0), indices(triangles, triangles + 3 * (size_t)triangleCount), isDead(triangleCount, 0) {
+
+        for (size_t i = 0; i < vertexCount; i++) {
+            this->parent[i] = (int)i;
+            this->nextMember[i] = (int)i;
+        }
+
+        this->adjacencyStart.assign(vertexCount + 1, 0);
+        for (unsigned int t = 0; t < triangleCount; t++) {
+            int i0 = this->indices[3 * t], i1 = this->indices[3 * t + 1], i2 = this->indices[3 * t + 2];
+            if (i0 == i1 || i1 == i2 || i2 == i0) {
+                this->isDead[t] = 1;
+                continue;
+            }
+            this->liveTriangles++;
+            for (int k = 0; k < 3; k++) {
+                this->adjacencyStart[this->indices[3 * t + k] + 1]++;
+            }
+        }
+        for (size_t i = 0; i < vertexCount; i++) {
+            this->adjacencyStart[i + 1] += this->adjacencyStart[i];
+        }
+        this->adjacency.resize(this->adjacencyStart[vertexCount]);
+        std::vector<unsigned int> fill(this->adjacencyStart.begin(), this->adjacencyStart.end() - 1);
+        for (unsigned int t = 0; t < triangleCount; t++) {
+            if (this->isDead[t]) {
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                this->adjacency[fill[this->indices[3 * t + k]]++] = (int)t;
+            }
+        }
+
+        for (unsigned int t = 0; t < triangleCount; t++) {
+            if (this->isDead[t]) {
+                continue;
+            }
+            Vec3<float> n = faceNormal(t);
+            const Vec3<float>& p0 = this->positions[this->indices[3 * t]];
+            Quadric q = Quadric::plane(n.x, n.y, n.z, -(n * p0), 1.0);
+            for (int k = 0; k < 3; k++) {
+                this->quadrics[this->indices[3 * t + k]].add(q);
+            }
+        }
+
+        // Edges with a single triangle lie on a border. Border planes go into the quadrics before
+        // any edge is priced, since both ends of an edge need theirs.
+        std::vector<std::pair<int, int>> edges;
+        for (size_t u = 0; u < vertexCount; u++) {
+            edgesFrom((int)u, edges);
+            for (size_t a = 0; a < edges.size(); a++) {
+                bool isFirst = a == 0 || edges[a - 1].first != edges[a].first;
+                bool isLast = a + 1 == edges.size() || edges[a + 1].first != edges[a].first;
+                if (isFirst && isLast) {
+                    addBorder((int)u, edges[a].first, edges[a].second);
+                }
+            }
+        }
+        for (size_t u = 0; u < vertexCount; u++) {
+            edgesFrom((int)u, edges);
+            for (size_t a = 0; a < edges.size(); a++) {
+                if (a == 0 || edges[a - 1].first != edges[a].first) {
+                    push((int)u, edges[a].first);
+                }
+            }
+        }
+        std::make_heap(this->heap.begin(), this->heap.end(), std::greater<Candidate>());
+        this->isHeap = true;
+    }
+
+    // Collapses edges until at most targetTriangles remain or no collapse is allowed
+    void simplify(unsigned int targetTriangles) {
+        while (this->liveTriangles > targetTriangles && !this->heap.empty()) {
+            std::pop_heap(this->heap.begin(), this->heap.end(), std::greater<Candidate>());
+            Candidate candidate = this->heap.back();
+            this->heap.pop_back();
+
+            if (this->versions[candidate.u] != candidate.versionU || this->versions[candidate.v] != candidate.versionV) {
+                continue;
+            }
+            collapse(candidate);
+        }
+    }
+
+    unsigned int triangleCount() const {
+        return this->liveTriangles;
+    }
+
+    // Square root of the largest collapse cost so far: the root mean square distance, in model
+    // units, of the worst merged vertex from the planes of the input triangles it replaced
+    float error() const {
+        return (float)std::sqrt(this->maxCost);
+    }
+
+    // The simplified mesh, with unused vertices dropped
+    void extract(std::vector<Vec3<float>>& vertices, std::vector<int>& triangles) {
+        std::vector<int> remap(this->positions.size(), -1);
+        std::vector<Vec3<float>> compacted;
+        std::vector<int> compactedTriangles;
+        compactedTriangles.reserve(3 * (size_t)this->liveTriangles);
+
+        for (size_t t = 0; t < this->isDead.size(); t++) {
+            if (this->isDead[t]) {
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                int vertex = find(this->indices[3 * t + k]);
+                if (remap[vertex] < 0) {
+                    remap[vertex] = (int)compacted.size();
+                    compacted.push_back(this->positions[vertex]);
+                }
+                compactedTriangles.push_back(remap[vertex]);
+            }
+        }
+        vertices.swap(compacted);
+        triangles.swap(compactedTriangles);
+    }
+
+private:
+    int find(int vertex) {
+        while (this->parent[vertex] != vertex) {
+            this->parent[vertex] = this->parent[this->parent[vertex]];
+            vertex = this->parent[vertex];
+        }
+        return vertex;
+    }
+
+    // Edges from u to higher vertices, once per triangle, as (other end, triangle) sorted by other end
+    void edgesFrom(int u, std::vector<std::pair<int, int>>& edges) const {
+        edges.clear();
+        for (unsigned int a = this->adjacencyStart[u]; a < this->adjacencyStart[u + 1]; a++) {
+            int t = this->adjacency[a];
+            for (int k = 0; k < 3; k++) {
+                int w = this->indices[3 * t + k];
+                if (w > u) {
+                    edges.push_back({ w, t });
+                }
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+    }
+
+    Vec3<float> faceNormal(unsigned int t) const {
+        const Vec3<float>& p0 = this->positions[this->indices[3 * t]];
+        const Vec3<float>& p1 = this->positions[this->indices[3 * t + 1]];
+        const Vec3<float>& p2 = this->positions[this->indices[3 * t + 2]];
+        Vec3<float> n = (p1 - p0) ^ (p2 - p0);
+        n.normalize();
+        return n;
+    }
+
+    // Plane through the border edge u-w, perpendicular to its triangle t
+    void addBorder(int u, int w, int t) {
+        const Vec3<float>& pu = this->positions[u];
+        Vec3<float> m = (this->positions[w] - pu) ^ faceNormal(t);
+        if (m.x == 0 && m.y == 0 && m.z == 0) {
+            return;
+        }
+        m.normalize();
+        // Border planes hold the border still but are not part of the surface being averaged over
+        Quadric q = Quadric::plane(m.x, m.y, m.z, -(m * pu), BORDER_WEIGHT);
+        q.weight = 0;
+        this->quadrics[u].add(q);
+        this->quadrics[w].add(q);
+    }
+
+    void push(int u, int v) {
+        Quadric q = this->quadrics[u];
+        q.add(this->quadrics[v]);
+
+        const Vec3<float>& pu = this->positions[u];
+        const Vec3<float>& pv = this->positions[v];
+        Vec3<float> targets[3] = { pu, pv, (pu + pv) * 0.5f };
+
+        Candidate candidate = { INFINITY, u, v, this->versions[u], this->versions[v], pu };
+        for (const Vec3<float>& target : targets) {
+            double cost = q.meanError(target);
+            if (cost < candidate.cost) {
+                candidate.cost = cost;
+                candidate.target = target;
+            }
+        }
+
+        this->heap.push_back(candidate);
+        if (this->isHeap) {
+            std::push_heap(this->heap.begin(), this->heap.end(), std::greater<Candidate>());
+        }
+    }
+
+    // Live triangles of the cluster whose representative is vertex
+    void gather(int vertex, std::vector<int>& triangles) const {
+        triangles.clear();
+        int member = vertex;
+        do {
+            for (unsigned int a = this->adjacencyStart[member]; a < this->adjacencyStart[member + 1]; a++) {
+                if (!this->isDead[this->adjacency[a]]) {
+                    triangles.push_back(this->adjacency[a]);
+                }
+            }
+            member = this->nextMember[member];
+        } while (member != vertex);
+    }
+
+    // Other corners of the triangles, as sorted unique representatives
+    void neighbors(int vertex, const std::vector<int>& triangles, std::vector<int>& out) {
+        out.clear();
+        for (int t : triangles) {
+            for (int k = 0; k < 3; k++) {
+                int corner = find(this->indices[3 * t + k]);
+                if (corner != vertex) {
+                    out.push_back(corner);
+                }
+            }
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    bool contains(int t, int vertex) {
+        return find(this->indices[3 * t]) == vertex || find(this->indices[3 * t + 1]) == vertex || find(this->indices[3 * t + 2]) == vertex;
+    }
+
+    // False when a triangle of vertex that survives the collapse would turn over or vanish
+    bool keepsOrientation(int vertex, int other, const std::vector<int>& triangles, const Vec3<float>& target) {
+        for (int t : triangles) {
+            if (contains(t, other)) {
+                continue;
+            }
+
+            Vec3<float> p[3];
+            int moved = 0;
+            for (int k = 0; k < 3; k++) {
+                int corner = find(this->indices[3 * t + k]);
+                p[k] = this->positions[corner];
+                if (corner == vertex) {
+                    moved = k;
+                }
+            }
+            Vec3<float> before = (p[1] - p[0]) ^ (p[2] - p[0]);
+            p[moved] = target;
+            Vec3<float> after = (p[1] - p[0]) ^ (p[2] - p[0]);
+            if (before * after <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void collapse(const Candidate& candidate) {
+        int u = candidate.u, v = candidate.v;
+        gather(u, this->trianglesU);
+        gather(v, this->trianglesV);
+
+        int shared = 0;
+        for (int t : this->trianglesU) {
+            shared += contains(t, v);
+        }
+        if (shared == 0) {
+            return;
+        }
+
+        // Link condition: the ends may only share the neighbors opposite the edge
+        neighbors(u, this->trianglesU, this->neighborsU);
+        neighbors(v, this->trianglesV, this->neighborsV);
+        int common = 0;
+        for (size_t a = 0, b = 0; a < this->neighborsU.size() && b < this->neighborsV.size();) {
+            if (this->neighborsU[a] < this->neighborsV[b]) {
+                a++;
+            } else if (this->neighborsU[a] > this->neighborsV[b]) {
+                b++;
+            } else {
+                common += this->neighborsU[a] != u && this->neighborsU[a] != v;
+                a++;
+                b++;
+            }
+        }
+        if (common > shared) {
+            return;
+        }
+
+        if (!keepsOrientation(u, v, this->trianglesU, candidate.target) || !keepsOrientation(v, u, this->trianglesV, candidate.target)) {
+            return;
+        }
+
+        for (int t : this->trianglesU) {
+            if (contains(t, v)) {
+                this->isDead[t] = 1;
+                this->liveTriangles--;
+            }
+        }
+
+        this->parent[u] = v;
+        std::swap(this->nextMember[u], this->nextMember[v]);
+        this->quadrics[v].add(this->quadrics[u]);
+        this->positions[v] = candidate.target;
+        this->versions[u]++;
+        this->versions[v]++;
+        this->maxCost = std::max(this->maxCost, candidate.cost);
+
+        gather(v, this->trianglesV);
+        neighbors(v, this->trianglesV, this->neighborsV);
+        for (int w : this->neighborsV) {
+            push(v, w);
+        }
+    }
+};
+
+// Successively coarser versions of a mesh, for drawing it with fewer triangles when it is small
+// on screen. Level 0 is the mesh itself and is not stored; level i > 0 has about half the
+// triangles of level i - 1 and its own vertices and face normals.
+class LodChain {
+public:
+    // Simplification stops once a level has this many triangles or fewer
+    static constexpr unsigned int MIN_TRIANGLES = 32;
+
+    // Largest error, relative to the bounding radius, a level may have
+    static constexpr float MAX_RELATIVE_ERROR = 0.25f;
+
+    struct Level {
+        SoAVertexBuffer vertices;
+        SoAVertexBuffer normals;
+
+        // Left empty by build(); filled in by whoever shades the level smoothly
+        SoAVertexBuffer vertexNormals;
+        std::vector<int> triangles;
+
+        // How far, in model units, the level may stray from the full mesh
+        float error = 0;
+    };
+
+private:
+    std::vector<std::unique_ptr<Level>> levels;
+
+    // Bounding sphere of the full mesh
+    Vec3<float> center;
+    float radius = 0;
+
+public:
+    bool empty() const {
+        return this->levels.empty();
+    }
+
+    // Levels including level 0
+    size_t size() const {
+        return this->levels.size() + 1;
+    }
+
+    // Level i > 0
+    const Level& level(size_t i) const {
+        return *this->levels[i - 1];
+    }
+
+    Level& level(size_t i) {
+        return *this->levels[i - 1];
+    }
+
+    float error(size_t i) const {
+        return i == 0 ? 0 : this->levels[i - 1]->error;
+    }
+
+    const Vec3<float>& boundsCenter() const {
+        return this->center;
+    }
+
+    float boundsRadius() const {
+        return this->radius;
+    }
+
+    void clear() {
+        this->levels.clear();
+    }
+
+    // Each level is simplified from the one before, and its error adds to theirs
+    void build(const SoAVertexBuffer& vertices, const int* triangles, unsigned int triangleCount) {
+        clear();
+
+        std::vector<Vec3<float>> levelVertices(vertices.length());
+        Vec3<float> lo(INFINITY, INFINITY, INFINITY), hi(-INFINITY, -INFINITY, -INFINITY);
+        for (size_t i = 0; i < vertices.length(); i++) {
+            levelVertices[i] = vertices.get(i);
+            lo = Vec3<float>(std::min(lo.x, levelVertices[i].x), std::min(lo.y, levelVertices[i].y), std::min(lo.z, levelVertices[i].z));
+            hi = Vec3<float>(std::max(hi.x, levelVertices[i].x), std::max(hi.y, levelVertices[i].y), std::max(hi.z, levelVertices[i].z));
+        }
+        this->center = (lo + hi) * 0.5f;
+        this->radius = 0;
+        for (const Vec3<float>& v : levelVertices) {
+            this->radius = std::max(this->radius, (v - this->center).length());
+        }
+
+        std::vector<int> levelTriangles(triangles, triangles + 3 * (size_t)triangleCount);
+        float error = 0;
+        while (levelTriangles.size() / 3 > MIN_TRIANGLES) {
+            unsigned int count = (unsigned int)(levelTriangles.size() / 3);
+            QuadricSimplifier simplifier(levelVertices.data(), levelVertices.size(), levelTriangles.data(), count);
+            simplifier.simplify(count / 2);
+
+            // Whatever is left cannot be simplified much further without breaking the surface, or
+            // has already strayed too far from it to stand in for the mesh at any distance
+            if (simplifier.triangleCount() > count - count / 8 || error + simplifier.error() > MAX_RELATIVE_ERROR * this->radius) {
+                break;
+            }
+            error += simplifier.error();
+            simplifier.extract(levelVertices, levelTriangles);
+
+            Level* level = new Level();
+            this->levels.emplace_back(level);
+            level->vertices.load(levelVertices.data(), levelVertices.size());
+            level->triangles = levelTriangles;
+            level->error = error;
+
+            // Same face normals the renderer derives for the full mesh
+            level->normals.resize(levelTriangles.size() / 3);
+            for (size_t t = 0; t < levelTriangles.size() / 3; t++) {
+                const Vec3<float>& v0 = levelVertices[levelTriangles[3 * t]];
+                const Vec3<float>& v1 = levelVertices[levelTriangles[3 * t + 1]];
+                const Vec3<float>& v2 = levelVertices[levelTriangles[3 * t + 2]];
+                Vec3<float> n = (v1 - v0) ^ (v2 - v1);
+                n.normalize();
+                level->normals.set(t, n);
+            }
+            for (size_t t = levelTriangles.size() / 3; t < level->normals.padded(); t++) {
+                level->normals.set(t, Vec3<float>(0, 0, 0));
+            }
+        }
+    }
+};
@@ -0,0 +1,548 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "geometry.hpp"
+
+// An indexed triangle mesh as the renderer consumes it: three indices into vertices per triangle.
+// Renderer::mesh() takes the vectors over by move, so loaded data is never copied a second time.
+struct Mesh {
+    std::vector<Vec3<float>> vertices;
+    std::vector<int> triangles;
+};
+
+// --- Reading ---
+
+// Reads a file in fixed-size chunks into one reusable buffer
+class ChunkReader {
+private:
+    std::FILE* file;
+    std::vector<char> buffer;
+
+public:
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+    explicit ChunkReader(const std::string& path) : buffer(CHUNK_SIZE) {
+        this->file = std::fopen(path.c_str(), "rb");
+        if (this->file == nullptr) {
+            throw std::runtime_error("Mesh Load Error: Cannot open " + path);
+        }
+    }
+
+    ChunkReader(const ChunkReader&) = delete;
+    ChunkReader& operator=(const ChunkReader&) = delete;
+
+    ~ChunkReader() {
+        std::fclose(this->file);
+    }
+
+    long long size() {
+        long long position = std::ftell(this->file);
+        std::fseek(this->file, 0, SEEK_END);
+        long long size = std::ftell(this->file);
+        std::fseek(this->file, position, SEEK_SET);
+        return size;
+    }
+
+    // Keeps the first keep bytes of the buffer, appends up to CHUNK_SIZE new bytes after them
+    // and returns how many were read
+    size_t refill(size_t keep) {
+        if (this->buffer.size() < keep + CHUNK_SIZE) {
+            this->buffer.resize(keep + CHUNK_SIZE);
+        }
+        return std::fread(this->buffer.data() + keep, 1, CHUNK_SIZE, this->file);
+    }
+
+    bool readExact(void* out, size_t length) {
+        return std::fread(out, 1, length, this->file) == length;
+    }
+
+    char* data() {
+        return this->buffer.data();
+    }
+};
+
+// --- Text parsing ---
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+// Decimal float with optional sign, fraction and exponent; returns nullptr when there is no number
+inline const char* parseFloat(const char* p, const char* end, float& out) {
+    static const double POWERS_OF_TEN[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = skipBlanks(p, end);
+    bool isNegative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        isNegative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+        if (mantissa < 100000000000000000ULL) {
+            mantissa = mantissa * 10 + (*p - '0');
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0) {
+        return nullptr;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool isExponentNegative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            isExponentNegative = *p == '-';
+            p++;
+        }
+        int value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            value = std::min(value * 10 + (*p - '0'), 1000);
+        }
+        exponent += isExponentNegative ? -value : value;
+    }
+
+    double result = (double)mantissa;
+    while (exponent > 22) {
+        result *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        result /= 1e22;
+        exponent += 22;
+    }
+    result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+
+    out = (float)(isNegative ? -result : result);
+    return p;
+}
+
+inline const char* parseInt(const char* p, const char* end, long long& out) {
+    p = skipBlanks(p, end);
+    bool isNegative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        isNegative = *p == '-';
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') {
+        return nullptr;
+    }
+
+    // Saturates just past INT_MAX, so long digit runs cannot overflow and are still out of range
+    long long value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        value = std::min(value * 10 + (*p - '0'), (long long)INT_MAX + 1);
+    }
+    out = isNegative ? -value : value;
+    return p;
+}
+
+// --- Wavefront OBJ ---
+
+// Parses "v" and "f" records; faces with more than three corners are fan-triangulated, and
+// texture/normal references in "v/vt/vn" corners are skipped. Everything else is ignored.
+class ObjParser {
+private:
+    Mesh& mesh;
+    std::vector<int> face;
+    long long lineNumber = 0;
+
+public:
+    explicit ObjParser(Mesh& mesh) : mesh(mesh) {}
+
+    void parseLine(const char* p, const char* end) {
+        this->lineNumber++;
+        p = skipBlanks(p, end);
+        if (end - p < 2 || (p[1] != ' ' && p[1] != '\t')) {
+            return;
+        }
+
+        if (p[0] == 'v') {
+            float x = 0, y = 0, z = 0;
+            p = parseFloat(p + 1, end, x);
+            if (p != nullptr) p = parseFloat(p, end, y);
+            if (p != nullptr) p = parseFloat(p, end, z);
+            if (p == nullptr) {
+                fail("Invalid vertex");
+            }
+            this->mesh.vertices.push_back(Vec3<float>(x, y, z));
+        } else if (p[0] == 'f') {
+            parseFace(p + 1, end);
+        }
+    }
+
+private:
+    void parseFace(const char* p, const char* end) {
+        this->face.clear();
+        long long vertexCount = (long long)this->mesh.vertices.size();
+
+        while (true) {
+            p = skipBlanks(p, end);
+            if (p >= end || *p == '#') {
+                break;
+            }
+
+            long long index = 0;
+            p = parseInt(p, end, index);
+            if (p == nullptr) {
+                fail("Invalid face");
+            }
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\r') {
+                p++;
+            }
+
+            // OBJ indices are 1-based; negative ones count back from the last vertex
+            long long resolved = index > 0 ? index - 1 : vertexCount + index;
+            if (index == 0 || resolved < 0 || resolved >= vertexCount) {
+                fail("Face index out of range");
+            }
+            this->face.push_back((int)resolved);
+        }
+
+        if (this->face.size() < 3) {
+            fail("Face with fewer than three corners");
+        }
+        for (size_t i = 1; i + 1 < this->face.size(); i++) {
+            this->mesh.triangles.push_back(this->face[0]);
+            this->mesh.triangles.push_back(this->face[i]);
+            this->mesh.triangles.push_back(this->face[i + 1]);
+        }
+    }
+
+    [[noreturn]] void fail(const char* message) {
+        throw std::runtime_error(std::string("Mesh Load Error: ") + message + " on OBJ line " + std::to_string(this->lineNumber));
+    }
+};
+
+inline Mesh loadObj(const std::string& path) {
+    Mesh mesh;
+    ChunkReader reader(path);
+
+    // A vertex or face line averages around 30 bytes
+    long long fileSize = reader.size();
+    mesh.vertices.reserve((size_t)(fileSize / 64));
+    mesh.triangles.reserve((size_t)(fileSize / 32) * 3);
+
+    ObjParser parser(mesh);
+    size_t kept = 0;
+    while (true) {
+        size_t read = reader.refill(kept);
+        size_t length = kept + read;
+        const char* begin = reader.data();
+        const char* end = begin + length;
+
+        const char* line = begin;
+        for (const char* newline; (newline = (const char*)std::memchr(line, '\n', end - line)) != nullptr; line = newline + 1) {
+            parser.parseLine(line, newline);
+        }
+
+        if (read == 0) {
+            if (line < end) {
+                parser.parseLine(line, end);
+            }
+            break;
+        }
+
+        // Carry the unfinished last line over to the next chunk
+        kept = end - line;
+        std::memmove(reader.data(), line, kept);
+    }
+
+    return mesh;
+}
+
+// --- Binary STL ---
+
+// Merges bit-identical positions into one vertex with open addressing. Each slot keeps the upper
+// hash bits next to the vertex index, so most probes are resolved without touching the vertex array.
+class VertexWelder {
+private:
+    std::vector<Vec3<float>>& vertices;
+    std::vector<uint64_t> table;
+    size_t mask;
+
+    static constexpr uint64_t EMPTY = 0;
+
+public:
+    VertexWelder(std::vector<Vec3<float>>& vertices, size_t expectedVertices) : vertices(vertices) {
+        size_t capacity = 16;
+        while (capacity < expectedVertices * 2) {
+            capacity <<= 1;
+        }
+        this->table.assign(capacity, EMPTY);
+        this->mask = capacity - 1;
+    }
+
+    int add(float x, float y, float z) {
+        // -0 and +0 are the same position
+        x += 0.0f;
+        y += 0.0f;
+        z += 0.0f;
+
+        uint64_t h = hash(x, y, z);
+        uint64_t tag = h & 0xFFFFFFFF00000000ULL;
+        size_t slot = (size_t)h & this->mask;
+
+        for (uint64_t entry; (entry = this->table[slot]) != EMPTY; slot = (slot + 1) & this->mask) {
+            if ((entry & 0xFFFFFFFF00000000ULL) == tag) {
+                int index = (int)(entry & 0xFFFFFFFFULL) - 1;
+                const Vec3<float>& v = this->vertices[index];
+                if (v.x == x && v.y == y && v.z == z) {
+                    return index;
+                }
+            }
+        }
+
+        int index = (int)this->vertices.size();
+        this->vertices.push_back(Vec3<float>(x, y, z));
+        this->table[slot] = tag | (uint64_t)(index + 1);
+
+        if (this->vertices.size() * 2 > this->table.size()) {
+            grow();
+        }
+        return index;
+    }
+
+private:
+    static uint64_t hash(float x, float y, float z) {
+        uint32_t bx, by, bz;
+        std::memcpy(&bx, &x, 4);
+        std::memcpy(&by, &y, 4);
+        std::memcpy(&bz, &z, 4);
+
+        uint64_t h = bx * 0x9E3779B97F4A7C15ULL;
+        h ^= (by + (h << 6) + (h >> 2)) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= (bz + (h << 6) + (h >> 2)) * 0x165667B19E3779F9ULL;
+        return h ^ (h >> 29);
+    }
+
+    void grow() {
+        std::vector<uint64_t> old;
+        old.swap(this->table);
+        this->table.assign(old.size() * 2, EMPTY);
+        this->mask = this->table.size() - 1;
+
+        for (uint64_t entry : old) {
+            if (entry == EMPTY) {
+                continue;
+            }
+            const Vec3<float>& v = this->vertices[(entry & 0xFFFFFFFFULL) - 1];
+            size_t slot = (size_t)hash(v.x, v.y, v.z) & this->mask;
+            while (this->table[slot] != EMPTY) {
+                slot = (slot + 1) & this->mask;
+            }
+            this->table[slot] = entry;
+        }
+    }
+};
+
+// Binary STL: 80 byte header, uint32 triangle count, then 50 byte records of a face normal, three
+// corners and a 2 byte attribute. STL repeats every corner, so corners are welded into shared vertices.
+// The stored normals are ignored; the renderer derives face normals from the winding.
+// Floats are read in host byte order, which matches the little-endian file on x86 and ARM.
+inline Mesh loadStl(const std::string& path) {
+    const size_t HEADER_SIZE = 84;
+    const size_t RECORD_SIZE = 50;
+
+    ChunkReader reader(path);
+    long long fileSize = reader.size();
+
+    unsigned char header[HEADER_SIZE];
+    if (!reader.readExact(header, HEADER_SIZE)) {
+        throw std::runtime_error("Mesh Load Error: Truncated STL header in " + path);
+    }
+
+    uint32_t triangleCount = (uint32_t)header[80] | (uint32_t)header[81] << 8 | (uint32_t)header[82] << 16 | (uint32_t)header[83] << 24;
+    if ((long long)(HEADER_SIZE + (size_t)triangleCount * RECORD_SIZE) > fileSize) {
+        if (std::strncmp((const char*)header, "solid", 5) == 0) {
+            throw std::runtime_error("Mesh Load Error: ASCII STL is not supported: " + path);
+        }
+        throw std::runtime_error("Mesh Load Error: Truncated STL triangle data in " + path);
+    }
+
+    Mesh mesh;
+    mesh.triangles.reserve((size_t)triangleCount * 3);
+    // Closed meshes have about half as many vertices as triangles
+    mesh.vertices.reserve(triangleCount / 2 + 3);
+    VertexWelder welder(mesh.vertices, triangleCount + 3);
+
+    uint32_t parsed = 0;
+    size_t kept = 0;
+    while (parsed < triangleCount) {
+        size_t length = kept + reader.refill(kept);
+        const char* record = reader.data();
+        size_t records = std::min<size_t>(length / RECORD_SIZE, triangleCount - parsed);
+        if (records == 0) {
+            throw std::runtime_error("Mesh Load Error: Truncated STL triangle data in " + path);
+        }
+
+        for (size_t i = 0; i < records; i++, record += RECORD_SIZE) {
+            float corners[9];
+            std::memcpy(corners, record + 12, sizeof(corners));
+            mesh.triangles.push_back(welder.add(corners[0], corners[1], corners[2]));
+            mesh.triangles.push_back(welder.add(corners[3], corners[4], corners[5]));
+            mesh.triangles.push_back(welder.add(corners[6], corners[7], corners[8]));
+        }
+        parsed += (uint32_t)records;
+
+        kept = length - records * RECORD_SIZE;
+        std::memmove(reader.data(), record, kept);
+    }
+
+    return mesh;
+}
+
+// Picks the loader from the file extension
+inline Mesh loadMesh(const std::string& path) {
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    for (char& c : extension) {
+        c = (char)std::tolower((unsigned char)c);
+    }
+
+    if (extension == "obj") {
+        return loadObj(path);
+    } else if (extension == "stl") {
+        return loadStl(path);
+    }
+    throw std::runtime_error("Mesh Load Error: Unknown mesh format: " + path);
+}
+
+// --- Writing ---
+
+inline void saveObj(const std::string& path, const Mesh& mesh) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Mesh Save Error: Cannot open " + path);
+    }
+
+    for (const Vec3<float>& v : mesh.vertices) {
+        std::fprintf(file, "v %.6g %.6g %.6g\n", v.x, v.y, v.z);
+    }
+    for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+        std::fprintf(file, "f %d %d %d\n", mesh.triangles[i] + 1, mesh.triangles[i + 1] + 1, mesh.triangles[i + 2] + 1);
+    }
+    std::fclose(file);
+}
+
+inline void saveStl(const std::string& path, const Mesh& mesh) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Mesh Save Error: Cannot open " + path);
+    }
+
+    char header[80] = "binary STL";
+    uint32_t triangleCount = (uint32_t)(mesh.triangles.size() / 3);
+    std::fwrite(header, 1, sizeof(header), file);
+    std::fwrite(&triangleCount, 4, 1, file);
+
+    for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+        const Vec3<float>& v0 = mesh.vertices[mesh.triangles[i]];
+        const Vec3<float>& v1 = mesh.vertices[mesh.triangles[i + 1]];
+        const Vec3<float>& v2 = mesh.vertices[mesh.triangles[i + 2]];
+        Vec3<float> n = (v1 - v0) ^ (v2 - v1);
+        n.normalize();
+
+        float record[12] = { n.x, n.y, n.z, v0.x, v0.y, v0.z, v1.x, v1.y, v1.z, v2.x, v2.y, v2.z };
+        uint16_t attribute = 0;
+        std::fwrite(record, 4, 12, file);
+        std::fwrite(&attribute, 2, 1, file);
+    }
+    std::fclose(file);
+}
+
+// --- Procedural meshes ---
+
+// UV sphere with 2 * rings * segments triangles, wound like the heart mesh (counter-clockwise seen from outside)
+inline Mesh makeSphere(float radius, int rings, int segments) {
+    if (rings < 2 || segments < 3) {
+        throw std::invalid_argument("Mesh Error: A sphere needs at least 2 rings and 3 segments!");
+    }
+
+    Mesh mesh;
+    mesh.vertices.reserve((size_t)(rings + 1) * segments);
+    mesh.triangles.reserve((size_t)rings * segments * 6);
+
+    const float PI = 3.14159265358979f;
+    for (int r = 0; r <= rings; r++) {
+        float phi = PI * r / rings;
+        for (int s = 0; s < segments; s++) {
+            float theta = 2 * PI * s / segments;
+            mesh.vertices.push_back(Vec3<float>(radius * sin(phi) * cos(theta), radius * cos(phi), radius * sin(phi) * sin(theta)));
+        }
+    }
+
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            int a = r * segments + s;
+            int b = r * segments + (s + 1) % segments;
+            int c = a + segments;
+            int d = b + segments;
+
+            mesh.triangles.insert(mesh.triangles.end(), { a, b, c });
+            mesh.triangles.insert(mesh.triangles.end(), { b, d, c });
+        }
+    }
+    return mesh;
+}
+
+// Torus around the y axis with 2 * rings * segments triangles: segments steps around the axis and
+// rings steps around the tube. Wound like makeSphere.
+inline Mesh makeTorus(float majorRadius, float minorRadius, int rings, int segments) {
+    if (rings < 3 || segments < 3) {
+        throw std::invalid_argument("Mesh Error: A torus needs at least 3 rings and 3 segments!");
+    }
+
+    Mesh mesh;
+    mesh.vertices.reserve((size_t)rings * segments);
+    mesh.triangles.reserve((size_t)rings * segments * 6);
+
+    const float PI = 3.14159265358979f;
+    for (int r = 0; r < rings; r++) {
+        float phi = 2 * PI * r / rings;
+        float distance = majorRadius + minorRadius * cos(phi);
+        for (int s = 0; s < segments; s++) {
+            float theta = 2 * PI * s / segments;
+            mesh.vertices.push_back(Vec3<float>(distance * cos(theta), minorRadius * sin(phi), distance * sin(theta)));
+        }
+    }
+
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            int a = r * segments + s;
+            int b = r * segments + (s + 1) % segments;
+            int c = (r + 1) % rings * segments + s;
+            int d = (r + 1) % rings * segments + (s + 1) % segments;
+
+            mesh.triangles.insert(mesh.triangles.end(), { a, c, b });
+            mesh.triangles.insert(mesh.triangles.end(), { b, c, d });
+        }
+    }
+    return mesh;
+}
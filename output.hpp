@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Where presented frames go in place of std::cout. A frame is only composed once ready() says it can
+// be written without waiting, so a render loop facing a slow terminal or pipe drops frames instead
+// of blocking, and the presenter's idea of what is on screen stays right.
+class OutputBackend {
+public:
+    virtual ~OutputBackend() {}
+
+    // False while the output is backed up: earlier bytes are still waiting or the fd is not writable
+    virtual bool ready() = 0;
+
+    // Waits up to timeout for ready()
+    virtual bool wait(std::chrono::milliseconds timeout) = 0;
+
+    // Hands over one whole frame; bytes that cannot go out yet are kept and sent first later on
+    virtual void write(const char* data, size_t size) = 0;
+
+    // Blocks until everything handed over is written
+    virtual void flush() = 0;
+};
+
+struct OutputStats {
+    unsigned long long frames = 0;
+    unsigned long long bytes = 0;
+
+    // write() calls, and those that wrote only part of what they were given
+    unsigned long long writeCalls = 0;
+    unsigned long long partialWrites = 0;
+
+    // ready() calls that found the output backed up
+    unsigned long long backpressure = 0;
+
+    // Failed writes; after the first, ready() stays false and nothing more is written
+    unsigned long long errors = 0;
+};
+
+#ifndef _WIN32
+// Writes frames straight to a file descriptor, each in a single write() call, bypassing iostream
+// and stdio buffering. Non-blocking mode reopens a terminal or pipe through /proc/self/fd as an open
+// file of its own with O_NONBLOCK, so the flag never reaches the shell or std::cout sharing the
+// original, however the process ends. Where that is not possible O_NONBLOCK is set on the fd itself
+// until destruction, except on a terminal, which then stays blocking; regular files never block.
+// Leftover bytes of a frame the fd only partly took are kept and written before anything else. At
+// most one frame's leftover is kept: ready() stays false until it is out, and a write() that comes
+// sooner waits for it, so the buffer never grows past the largest frame.
+class FdOutput : public OutputBackend {
+private:
+    int fd;
+    bool isNonBlocking = false;
+    bool ownsFd = false;
+    int originalFlags = -1;
+    bool isFailed = false;
+
+    // Bytes of the last frame not written yet, from pendingStart on. Reserved up front; a larger
+    // frame grows it once.
+    std::string pending;
+    size_t pendingStart = 0;
+
+    mutable std::mutex statsMutex;
+    OutputStats stats;
+
+public:
+    FdOutput(int fd = STDOUT_FILENO, bool nonBlocking = false, size_t reserveBytes = 1 << 16)
+        : fd(fd) {
+        if (fd < 0) {
+            throw std::invalid_argument("FdOutput Error: Invalid file descriptor!");
+        }
+        if (nonBlocking) {
+            openNonBlocking();
+        }
+        this->pending.reserve(reserveBytes);
+    }
+
+    FdOutput(const FdOutput&) = delete;
+    FdOutput& operator=(const FdOutput&) = delete;
+
+    // Writes what is still pending, waiting for the fd if it has to, and closes or restores the fd
+    ~FdOutput() {
+        flush();
+        if (this->ownsFd) {
+            close(this->fd);
+        } else if (this->originalFlags != -1) {
+            fcntl(this->fd, F_SETFL, this->originalFlags);
+        }
+    }
+
+    // POLLOUT only means some room is free. A non-blocking fd then takes what fits and keeps the
+    // rest pending; a blocking one, such as a terminal that could not be reopened, may still
+    // block in write() on a frame larger than that room.
+    bool ready() override {
+        bool isReady = !this->isFailed && isWritable(0);
+        if (isReady && pendingBytes() > 0) {
+            sendPending();
+            isReady = !this->isFailed && pendingBytes() == 0 && isWritable(0);
+        }
+        if (!isReady) {
+            std::lock_guard<std::mutex> lock(this->statsMutex);
+            this->stats.backpressure++;
+        }
+        return isReady;
+    }
+
+    bool wait(std::chrono::milliseconds timeout) override {
+        if (!this->isFailed) {
+            isWritable((int)timeout.count());
+        }
+        return ready();
+    }
+
+    // Waits for the leftover of the frame before if ready() was not checked first
+    void write(const char* data, size_t size) override {
+        flush();
+        if (this->isFailed) {
+            return;
+        }
+        size_t sent = send(data, size);
+        if (sent < size && !this->isFailed) {
+            this->pending.assign(data + sent, size - sent);
+        }
+        std::lock_guard<std::mutex> lock(this->statsMutex);
+        this->stats.frames++;
+    }
+
+    void flush() override {
+        while (!this->isFailed && pendingBytes() > 0) {
+            isWritable(-1);
+            sendPending();
+        }
+    }
+
+    // False when non-blocking mode was asked for but the fd is a terminal that could not be reopened
+    bool nonBlocking() const {
+        return this->isNonBlocking;
+    }
+
+    bool failed() const {
+        return this->isFailed;
+    }
+
+    OutputStats getStats() const {
+        std::lock_guard<std::mutex> lock(this->statsMutex);
+        return this->stats;
+    }
+
+private:
+    void openNonBlocking() {
+        struct stat info;
+        if (fstat(this->fd, &info) != 0) {
+            throw std::runtime_error("FdOutput Error: Cannot inspect the file descriptor!");
+        }
+        if (S_ISREG(info.st_mode)) {
+            return;
+        }
+
+        if (S_ISCHR(info.st_mode) || S_ISFIFO(info.st_mode)) {
+            std::string path = "/proc/self/fd/" + std::to_string(this->fd);
+            int reopened = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+            if (reopened != -1) {
+                this->fd = reopened;
+                this->ownsFd = true;
+                this->isNonBlocking = true;
+                return;
+            }
+        }
+        if (isatty(this->fd)) {
+            return;
+        }
+
+        this->originalFlags = fcntl(this->fd, F_GETFL);
+        if (this->originalFlags == -1 || fcntl(this->fd, F_SETFL, this->originalFlags | O_NONBLOCK) == -1) {
+            throw std::runtime_error("FdOutput Error: Cannot make the file descriptor non-blocking!");
+        }
+        this->isNonBlocking = true;
+    }
+
+    size_t pendingBytes() const {
+        return this->pending.size() - this->pendingStart;
+    }
+
+    // Polls for room in the fd; a timeout of -1 waits for as long as it takes. Errors and hangups
+    // count as writable, so the next write reports them.
+    bool isWritable(int timeoutMs) {
+        pollfd output = { this->fd, POLLOUT, 0 };
+        int result;
+        do {
+            result = poll(&output, 1, timeoutMs);
+        } while (result == -1 && errno == EINTR);
+        return result != 0;
+    }
+
+    void sendPending() {
+        this->pendingStart += send(&this->pending[this->pendingStart], pendingBytes());
+        if (pendingBytes() == 0) {
+            this->pending.clear();
+            this->pendingStart = 0;
+        }
+    }
+
+    // Writes size bytes of data in one call unless a blocking fd takes only part of them, in which
+    // case it is called again for the rest. A non-blocking fd stops at the first partial write.
+    // Returns how many bytes were written.
+    size_t send(const char* data, size_t size) {
+        size_t sent = 0;
+        while (sent < size) {
+            ssize_t written = ::write(this->fd, data + sent, size - sent);
+            int error = errno;
+            {
+                std::lock_guard<std::mutex> lock(this->statsMutex);
+                this->stats.writeCalls++;
+                if (written > 0) {
+                    this->stats.bytes += written;
+                    if ((size_t)written < size - sent) {
+                        this->stats.partialWrites++;
+                    }
+                } else if (written == -1 && error != EINTR && error != EAGAIN && error != EWOULDBLOCK) {
+                    this->stats.errors++;
+                    this->isFailed = true;
+                }
+            }
+
+            if (written > 0) {
+                sent += written;
+                if (this->isNonBlocking) {
+                    // Anything left means the fd is full, and trying again now would fail with EAGAIN
+                    break;
+                }
+            } else if (written != -1 || error != EINTR) {
+                break;
+            }
+        }
+        return sent;
+    }
+};
+#endif
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "output.hpp"
+
+// Monochrome leaves the foreground to whatever the terminal is set to. The others give every cell
+// its own color, from the xterm 256-color palette or as 24-bit RGB.
+enum class ColorMode {
+    Monochrome,
+    Palette256,
+    TrueColor
+};
+
+struct PresentStats {
+    size_t frameBytes = 0;          // Bytes written for the last frame
+    size_t fullFrameBytes = 0;      // Bytes a full repaint of the last frame costs, without colors
+    size_t colorBytes = 0;          // Bytes of color escape sequences within frameBytes
+    unsigned int changedCells = 0;  // Cells that differed from the displayed frame, counted until a full repaint is chosen
+    bool isFullRepaint = false;
+
+    unsigned long long totalBytes = 0;
+    unsigned long long totalColorBytes = 0;
+    unsigned long long frames = 0;
+};
+
+// Keeps the frame currently on the terminal and writes only the cells that changed: one cursor
+// move per run of changed characters. Falls back to a full repaint when the diff would be larger.
+// With colors, a color sequence is written only where a cell's color differs from the one the
+// terminal was last set to, so a run of one color costs one sequence. Spaces keep whatever color
+// is set, as only their background shows.
+class TerminalPresenter {
+public:
+    // Longest color sequence, "\x1b[38;2;255;255;255m"
+    static constexpr unsigned int MAX_COLOR_BYTES = 19;
+
+private:
+    // Color the terminal is set to is unknown
+    static constexpr uint32_t NO_COLOR = 0xFFFFFFFF;
+
+    unsigned int width;
+    unsigned int height;
+
+    std::vector<char> displayedFrame;
+    bool hasDisplayedFrame = false;
+    bool isDiffEnabled = true;
+
+    // Rows of the displayed frame that may hold more than the blank rows outside them
+    unsigned int displayedRowBegin = 0;
+    unsigned int displayedRowEnd = 0;
+
+    // Colors are kept as the terminal sees them: palette indices or 0xRRGGBB
+    ColorMode colorMode = ColorMode::Monochrome;
+    std::vector<uint32_t> displayedColors;
+    std::vector<uint32_t> rowColors;
+    uint32_t terminalColor = NO_COLOR;
+
+    // Size of the last full repaint, past which a diff is abandoned
+    size_t fullRepaintBytes;
+
+    // Last color converted to the palette, since neighbouring cells mostly share one
+    uint32_t lastRgb = NO_COLOR;
+    uint32_t lastPaletteIndex = 0;
+
+    std::string output;
+    PresentStats stats;
+
+public:
+    TerminalPresenter(unsigned int width, unsigned int height)
+        : width(width), height(height), displayedFrame(width * height), displayedRowEnd(height) {
+        // Full repaint: "\x1b[H" plus every row and its newline
+        this->stats.fullFrameBytes = 3 + width * height + height;
+        this->fullRepaintBytes = this->stats.fullFrameBytes;
+
+        // A diff is abandoned after the row that takes it past a full repaint, and no row costs
+        // more than twice its width plus one cursor move, so composing never reallocates
+        this->output.reserve(this->stats.fullFrameBytes + 2 * width + cursorMoveBytes(height, width));
+    }
+
+    void diff(bool isEnabled) {
+        this->isDiffEnabled = isEnabled;
+        invalidate();
+    }
+
+    // Forces a full repaint next frame, e.g. after something else has written to the terminal
+    void invalidate() {
+        this->hasDisplayedFrame = false;
+        this->terminalColor = NO_COLOR;
+    }
+
+    void colors(ColorMode colorMode) {
+        this->colorMode = colorMode;
+        this->fullRepaintBytes = this->stats.fullFrameBytes;
+        if (colorMode != ColorMode::Monochrome) {
+            // A full repaint with a color sequence before every cell, and a diff abandoned one row past it
+            size_t cells = (size_t)this->width * this->height;
+            this->displayedColors.resize(cells);
+            this->rowColors.resize(this->width);
+            this->output.reserve(this->stats.fullFrameBytes + cells * MAX_COLOR_BYTES
+                                 + this->width * (2 + MAX_COLOR_BYTES) + cursorMoveBytes(this->height, this->width));
+        }
+        invalidate();
+    }
+
+    const PresentStats& getStats() const {
+        return this->stats;
+    }
+
+    // Builds the bytes that turn the displayed frame into this one; the result stays valid until the next call
+    const std::string& compose(const char* frame) {
+        return compose(frame, nullptr, 0, this->height);
+    }
+
+    const std::string& compose(const char* frame, unsigned int rowBegin, unsigned int rowEnd) {
+        return compose(frame, nullptr, rowBegin, rowEnd);
+    }
+
+    // As compose(frame), where colors holds 0xRRGGBB per cell, or is nullptr for no colors, and the
+    // rows outside [rowBegin, rowEnd) are blank: the same in every frame given with a row range,
+    // colors included, e.g. all background. Only the rows inside this range or the displayed
+    // frame's are compared and kept.
+    const std::string& compose(const char* frame, const uint32_t* colors, unsigned int rowBegin, unsigned int rowEnd) {
+        rowEnd = std::min(rowEnd, this->height);
+        rowBegin = std::min(rowBegin, rowEnd);
+        if (this->colorMode == ColorMode::Monochrome) {
+            colors = nullptr;
+        }
+
+        this->output.clear();
+        this->stats.changedCells = 0;
+        this->stats.colorBytes = 0;
+
+        unsigned int diffBegin = rowBegin, diffEnd = rowEnd;
+        if (diffBegin == diffEnd) {
+            diffBegin = this->displayedRowBegin;
+            diffEnd = this->displayedRowEnd;
+        } else if (this->displayedRowBegin < this->displayedRowEnd) {
+            diffBegin = std::min(diffBegin, this->displayedRowBegin);
+            diffEnd = std::max(diffEnd, this->displayedRowEnd);
+        }
+
+        uint32_t diffColor = this->terminalColor;
+        if (!this->isDiffEnabled || !this->hasDisplayedFrame || !composeDiff(frame, colors, diffBegin, diffEnd)) {
+            this->terminalColor = diffColor;
+            composeFull(frame, colors);
+            diffBegin = 0;
+            diffEnd = this->height;
+        }
+
+        if (diffBegin < diffEnd) {
+            std::memcpy(this->displayedFrame.data() + diffBegin * this->width, frame + diffBegin * this->width,
+                        (diffEnd - diffBegin) * this->width);
+        }
+        this->displayedRowBegin = rowBegin;
+        this->displayedRowEnd = rowEnd;
+        this->hasDisplayedFrame = true;
+
+        this->stats.frameBytes = this->output.size();
+        this->stats.totalBytes += this->output.size();
+        this->stats.totalColorBytes += this->stats.colorBytes;
+        this->stats.frames++;
+        return this->output;
+    }
+
+    void present(const char* frame, std::ostream& os = std::cout) {
+        present(frame, nullptr, 0, this->height, os);
+    }
+
+    void present(const char* frame, unsigned int rowBegin, unsigned int rowEnd, std::ostream& os = std::cout) {
+        present(frame, nullptr, rowBegin, rowEnd, os);
+    }
+
+    void present(const char* frame, const uint32_t* colors, unsigned int rowBegin, unsigned int rowEnd, std::ostream& os = std::cout) {
+        const std::string& bytes = compose(frame, colors, rowBegin, rowEnd);
+        os.write(bytes.data(), bytes.size());
+    }
+
+    // As present(frame, colors, rowBegin, rowEnd, os), handing the frame to output in one piece.
+    // Check output.ready() first: a composed frame counts as displayed whether or not it was written.
+    void present(const char* frame, const uint32_t* colors, unsigned int rowBegin, unsigned int rowEnd, OutputBackend& output) {
+        const std::string& bytes = compose(frame, colors, rowBegin, rowEnd);
+        output.write(bytes.data(), bytes.size());
+    }
+
+    // Nearest xterm palette entry: the 6x6x6 color cube or the 24-step gray ramp
+    static uint32_t paletteIndex(uint32_t rgb) {
+        static const int levels[6] = { 0, 95, 135, 175, 215, 255 };
+        int channels[3] = { (int)(rgb >> 16) & 0xFF, (int)(rgb >> 8) & 0xFF, (int)rgb & 0xFF };
+
+        int cube[3], cubeDistance = 0;
+        for (int c = 0; c < 3; c++) {
+            cube[c] = channels[c] < 48 ? 0 : channels[c] < 115 ? 1 : (channels[c] - 35) / 40;
+            cubeDistance += (channels[c] - levels[cube[c]]) * (channels[c] - levels[cube[c]]);
+        }
+
+        int gray = std::min(std::max((channels[0] + channels[1] + channels[2]) / 3 - 3, 0) / 10, 23);
+        int grayDistance = 0;
+        for (int c = 0; c < 3; c++) {
+            grayDistance += (channels[c] - (8 + 10 * gray)) * (channels[c] - (8 + 10 * gray));
+        }
+
+        return grayDistance < cubeDistance ? 232 + gray : 16 + 36 * cube[0] + 6 * cube[1] + cube[2];
+    }
+
+private:
+    void composeFull(const char* frame, const uint32_t* colors) {
+        this->output.clear();
+        this->stats.colorBytes = 0;
+        this->output += "\x1b[H";
+        for (unsigned int y = 0; y < this->height; y++) {
+            const char* row = frame + y * this->width;
+            if (colors != nullptr) {
+                convertRow(colors + y * this->width, y);
+                appendCells(row, this->displayedColors.data() + y * this->width, 0, this->width - 1);
+            } else {
+                this->output.append(row, this->width);
+            }
+            this->output += '\n';
+        }
+        this->fullRepaintBytes = this->output.size();
+        this->stats.isFullRepaint = true;
+    }
+
+    // Compares rows [rowBegin, rowEnd). Returns false as soon as the diff grows past the size of a full repaint.
+    bool composeDiff(const char* frame, const uint32_t* colors, unsigned int rowBegin, unsigned int rowEnd) {
+        this->stats.isFullRepaint = false;
+        const char* displayed = this->displayedFrame.data();
+
+        for (unsigned int y = rowBegin; y < rowEnd; y++) {
+            const char* row = frame + y * this->width;
+            const char* displayedRow = displayed + y * this->width;
+
+            // The displayed colors of the row are only read here, so they can be replaced right away
+            const uint32_t* displayedColors = nullptr;
+            if (colors != nullptr) {
+                std::memcpy(this->rowColors.data(), this->displayedColors.data() + y * this->width, this->width * sizeof(uint32_t));
+                displayedColors = this->rowColors.data();
+                convertRow(colors + y * this->width, y);
+            }
+            const uint32_t* rowColors = colors != nullptr ? this->displayedColors.data() + y * this->width : nullptr;
+
+            int runStart = -1;
+            int runEnd = -1;
+            for (unsigned int x = 0; x < this->width; x++) {
+                if (row[x] == displayedRow[x] && (rowColors == nullptr || row[x] == ' ' || rowColors[x] == displayedColors[x])) {
+                    continue;
+                }
+                this->stats.changedCells++;
+
+                // Rewriting a short gap of unchanged cells is cheaper than another cursor move
+                if (runStart >= 0 && (int)x - runEnd - 1 > (int)cursorMoveBytes(y, x)) {
+                    appendRun(row, rowColors, y, runStart, runEnd);
+                    runStart = -1;
+                }
+                if (runStart < 0) {
+                    runStart = x;
+                }
+                runEnd = x;
+            }
+            if (runStart >= 0) {
+                appendRun(row, rowColors, y, runStart, runEnd);
+            }
+
+            if (this->output.size() > this->fullRepaintBytes) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static unsigned int digits(unsigned int value) {
+        unsigned int count = 1;
+        while (value >= 10) {
+            value /= 10;
+            count++;
+        }
+        return count;
+    }
+
+    static unsigned int cursorMoveBytes(unsigned int y, unsigned int x) {
+        return 4 + digits(y + 1) + digits(x + 1);
+    }
+
+    void appendNumber(unsigned int value) {
+        char buffer[10];
+        int length = 0;
+        do {
+            buffer[length++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+
+        while (length > 0) {
+            this->output += buffer[--length];
+        }
+    }
+
+    // Stores the colors of row y as the terminal sees them in displayedColors
+    void convertRow(const uint32_t* colors, unsigned int y) {
+        uint32_t* converted = this->displayedColors.data() + y * this->width;
+        if (this->colorMode == ColorMode::TrueColor) {
+            for (unsigned int x = 0; x < this->width; x++) {
+                converted[x] = colors[x] & 0xFFFFFF;
+            }
+            return;
+        }
+
+        for (unsigned int x = 0; x < this->width; x++) {
+            if (colors[x] != this->lastRgb) {
+                this->lastRgb = colors[x];
+                this->lastPaletteIndex = paletteIndex(colors[x]);
+            }
+            converted[x] = this->lastPaletteIndex;
+        }
+    }
+
+    void appendColor(uint32_t color) {
+        size_t start = this->output.size();
+        if (this->colorMode == ColorMode::TrueColor) {
+            this->output += "\x1b[38;2;";
+            appendNumber(color >> 16);
+            this->output += ';';
+            appendNumber((color >> 8) & 0xFF);
+            this->output += ';';
+            appendNumber(color & 0xFF);
+        } else {
+            this->output += "\x1b[38;5;";
+            appendNumber(color);
+        }
+        this->output += 'm';
+        this->terminalColor = color;
+        this->stats.colorBytes += this->output.size() - start;
+    }
+
+    // Cells [start, end] of the row, switching colors only where a visible cell needs another one.
+    // Without colors, the row as is.
+    void appendCells(const char* row, const uint32_t* colors, int start, int end) {
+        if (colors == nullptr) {
+            this->output.append(row + start, end - start + 1);
+            return;
+        }
+
+        int written = start;
+        for (int x = start; x <= end; x++) {
+            if (row[x] != ' ' && colors[x] != this->terminalColor) {
+                this->output.append(row + written, x - written);
+                appendColor(colors[x]);
+                written = x;
+            }
+        }
+        this->output.append(row + written, end + 1 - written);
+    }
+
+    void appendRun(const char* row, const uint32_t* colors, unsigned int y, int runStart, int runEnd) {
+        this->output += "\x1b[";
+        appendNumber(y + 1);
+        this->output += ';';
+        appendNumber(runStart + 1);
+        this->output += 'H';
+        appendCells(row, colors, runStart, runEnd);
+    }
+};
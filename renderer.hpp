@@ -1,13 +1,152 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <climits>
 #include <cmath>
+#include <cstdio>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <cstring>
 #include <thread>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
+#include "arena.hpp"
+#include "asyncpresenter.hpp"
+#include "binarymesh.hpp"
+#include "bvh.hpp"
+#include "coarsedepth.hpp"
+#include "framecache.hpp"
+#include "lod.hpp"
 #include "geometry.hpp"
+#include "governor.hpp"
+#include "instrumentation.hpp"
+#include "mesh.hpp"
+#include "presenter.hpp"
+#include "scene.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+// ObjectScan samples each triangle in world space every scanStep units and projects every sample.
+// ScreenSpace projects the three vertices and fills every covered screen cell exactly once.
+enum class RasterMode {
+    ObjectScan,
+    ScreenSpace
+};
+
+// Flat lights each triangle by its face normal. Smooth lights each vertex by its area-weighted
+// vertex normal and interpolates the light across the triangle.
+enum class ShadingMode {
+    Flat,
+    Smooth
+};
+
+// Screen-space setup of one triangle. Edge functions are exact 24.8 fixed point, and depth is a
+// plane evaluated at absolute cell coordinates, so a cell gets the same result whichever tile
+// or thread rasterizes it.
+struct TriangleSetup {
+    // Edge i is inside where a * px + b * py + c >= 0, px and py being fixed point sample positions
+    int64_t a0, b0, c0;
+    int64_t a1, b1, c1;
+    int64_t a2, b2, c2;
+
+    // 1/z = ooz + oozDx * (x - x0) + oozDy * (y - y0)
+    float x0, y0, ooz, oozDx, oozDy;
+
+    // Bounds of 1/z over every cell the triangle covers, rounding of the plane included
+    float minOoz, maxOoz;
+
+    int minX, maxX, minY, maxY;
+    char color;
+
+    // Slot of the instance's color, written to the material plane with colorOutput()
+    unsigned char material;
+
+    // ShadingMode::Smooth: gradient level = level + levelDx * (x - x0) + levelDy * (y - y0), cells
+    // at level 0 or below being unlit. color is unused.
+    bool isSmooth;
+    float level, levelDx, levelDy;
+};
+
+// Inclusive cell bounds, empty while minX > maxX
+struct ScreenRect {
+    int minX = INT_MAX, minY = INT_MAX;
+    int maxX = INT_MIN, maxY = INT_MIN;
+
+    bool empty() const {
+        return this->minX > this->maxX;
+    }
+
+    void add(int minX, int minY, int maxX, int maxY) {
+        this->minX = std::min(this->minX, minX);
+        this->minY = std::min(this->minY, minY);
+        this->maxX = std::max(this->maxX, maxX);
+        this->maxY = std::max(this->maxY, maxY);
+    }
+};
+
+// Per-frame results of the culling stage that runs between vertex transformation and rasterization
+struct CullStats {
+    unsigned long long triangles = 0;
+
+    // Triangles removed, by the first test that rejected them
+    unsigned long long backFacing = 0;
+    unsigned long long outsideFrustum = 0;
+    unsigned long long unlit = 0;
+
+    // Triangles crossing the near plane; these are clipped, not removed
+    unsigned long long nearClipped = 0;
+
+    // Triangles skipped because their BVH node lies behind what the z-buffer already holds
+    unsigned long long occluded = 0;
+
+    // Triangles handed to the rasterizer
+    unsigned long long drawn = 0;
+
+    // Drawn triangles found hidden by the coarse depth buffer before any cell was visited, and the
+    // blocks skipped inside triangles that were partly visible. With tiles on several threads a
+    // triangle counts once for every tile it overlaps.
+    unsigned long long depthRejected = 0;
+    unsigned long long depthRejectedBlocks = 0;
+
+    // BVH nodes tested, and those skipped whole by the frustum and occlusion tests
+    unsigned long long nodesVisited = 0;
+    unsigned long long nodesCulled = 0;
+    unsigned long long nodesOccluded = 0;
+
+    // Instances drawn, and those skipped whole because their bounds lie outside the view
+    unsigned long long instances = 0;
+    unsigned long long instancesCulled = 0;
+};
+
+// Closest view depth (z + distanceFromCam) that is rendered. Triangles are clipped against it, so
+// 1/depth stays positive and bounded.
+const float NEAR_PLANE = 0.1f;
+
+// ObjectScan asks the coarse depth buffer about a triangle only when it would take at least this
+// many samples; smaller triangles are cheaper to scan than to test.
+const float OCCLUSION_TEST_SAMPLES = 64;
+
+const int SUBPIXEL_BITS = 8;
+const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+
+// Vertices further off-screen than this cannot be represented in 24.8 fixed point without overflow
+const float GUARD_BAND = (float)(1 << 19);
+
+// Light level of lightPlane() cells that hold the background
+const unsigned char NO_LIGHT = 0xFF;
+
+// With colorOutput(), the color of cells holding the background or text such as the status line
+const uint32_t TEXT_COLOR = 0xC0C0C0;
+
+const int TILE_WIDTH = 16;
+const int TILE_HEIGHT = 8;
+const int TILE_AREA = TILE_WIDTH * TILE_HEIGHT;
 
 class Renderer {
 private:
@@ -31,17 +170,95 @@ private:
     
     unsigned int animationDelay;
     float scanStep;
+
+    RasterMode rasterMode = RasterMode::ObjectScan;
+    ShadingMode shadingMode = ShadingMode::Flat;
     
     // --- Function modifiable fields ---
 
-    unsigned int lengthOfVertexArray = 0;
-    Vec3<float>* vertexArray;
+    // Meshes, and the objects drawn with them into the shared buffers. Model 0 is the mesh set by
+    // vertex(), triangle(), normal() and mesh(), and instance 0 draws it with transform(); further
+    // models and instances come from addModel() and addInstance(). Models are prepared on the first
+    // render after they change, however many instances use them.
+    std::vector<std::unique_ptr<Model>> models;
+    std::vector<Instance> instances;
+
+    // Instance indices grouped by model, so consecutive instances reuse the same mesh data
+    std::vector<unsigned int> drawOrder;
+    bool isDrawOrderStale = true;
+
+    // Rebuilt once per instance. Vertices are in view space for RasterMode::ObjectScan,
+    // and screen x, screen y and 1/z for RasterMode::ScreenSpace.
+    SoAVertexBuffer transformedVertexStream;
+    SoAVertexBuffer transformedNormalStream;
+    float* faceLightArray = nullptr;
+
+    // ShadingMode::Smooth only: vertex normals of the instance and the light of each vertex
+    SoAVertexBuffer transformedVertexNormalStream;
+    float* vertexLightArray = nullptr;
+
+    VertexKernels kernels = selectVertexKernels();
+
+    // Scratch memory of the current frame: setups, tile bins and traversal stacks. Reset once every
+    // frame is rasterized, and grown only when a frame needs more than any before it, so rendering
+    // the same workload again does not allocate.
+    FrameArena frameArena;
+
+    // Screen-space triangles of the current frame, in submission order, and how many the last frame had
+    ArenaArray<TriangleSetup> setupArray;
+    size_t lastSetupCount = 0;
+
+    // Tiled rendering, used with more than one thread: each tile lists the setups overlapping it
+    // and is rasterized by one worker into that worker's private tile buffers. The setups of tile t
+    // are tileBinSetups[tileBinStart[t]] up to tileBinSetups[tileBinStart[t + 1]], in the frame arena.
+    std::unique_ptr<ThreadPool> threadPool;
+    unsigned int tilesX = 0;
+    unsigned int tilesY = 0;
+    int* tileBinStart = nullptr;
+    int* tileBinSetups = nullptr;
+    std::vector<char> tileOutputBuffer;
+    std::vector<float> tileZBuffer;
+    std::vector<unsigned char> tileMaterialBuffer;
+
+    // Block-level depth bounds of zBuffer, and of each worker's tile buffer
+    CoarseDepthBuffer coarseDepth;
+    std::vector<CoarseDepthBuffer> tileCoarseDepth;
+    bool isEarlyDepthTest = false;
+
+    TerminalPresenter presenter;
+
+    // When set, printBuffer hands finished frames to a presenter thread instead of writing them itself
+    std::unique_ptr<AsyncPresenter> asyncPresenter;
+    bool isDiffOutput = true;
+
+    // Set by output(): frames go there instead of std::cout, and render() skips frames while it is
+    // backed up, counting them in blockedFrames
+    std::shared_ptr<OutputBackend> outputBackend;
+    unsigned long long blockedFrames = 0;
+
+    // When set, replaces the fixed animationDelay sleep and advances the animation by elapsed time
+    FrameGovernor governor;
+    bool isGoverned = false;
+
+    // Set by headless(): render() neither prints, sleeps nor paces
+    bool isHeadless = false;
+
+    // Cleared while frameBuffers() points outputBuffer and zBuffer at caller memory
+    bool ownsBuffers = true;
 
-    unsigned int lengthOfTriangleArray = 0;
-    int* triangleArray;
+    // Cells written since the last resetBuffers(); everything outside holds the background and depth 0
+    ScreenRect dirtyBounds;
 
-    unsigned int lengthOfNormalArray = 0;
-    Vec3<float>* normalArray;
+    // Set by colorOutput(): every drawn cell records its instance's color slot in materialPlane, and
+    // before presenting, cellColors gets the slot's color shaded by the cell's gradient level from
+    // shadeTable, indexed by slot * 256 + character. Slot 0 is white.
+    ColorMode colorMode = ColorMode::Monochrome;
+    std::vector<uint32_t> instanceColors = std::vector<uint32_t>(1, 0xFFFFFF);
+    std::vector<unsigned char> materials;
+    unsigned char* materialPlane = nullptr;
+    std::vector<uint32_t> cellColors;
+    std::vector<uint32_t> shadeTable;
+    unsigned int colorLevels = 2;
 
     float distanceFromCam = 5.0f;
     
@@ -54,6 +271,56 @@ private:
     float angleZ = 0.0f;
 
     Vec3<float> translateDirection = Vec3<float>(0.0f, 0.0f, 0.0f);
+
+    // Animated rotation and translation of the current frame, applied to every instance
+    Mat4<float> sceneTransform;
+
+    // Model to view space for the instance being drawn, used to clip triangles crossing the near plane
+    Mat4<float> frameModel;
+
+    bool isBackFaceCulling = false;
+    CullStats cullCounters;
+
+#ifdef RENDERER_INSTRUMENTATION
+    // Timers and counters of the frame being rendered, published to lastStatistics once it is
+    // done. Tiles count samples per worker.
+    FrameStats statistics;
+    FrameStats lastStatistics;
+    std::vector<SampleCounters> tileSamples;
+#endif
+    bool isStatusLine = false;
+
+    // Set by overlay(): draws text such as a Timeline over every frame once the scene is done
+    std::function<void(Renderer&)> overlayCallback;
+
+    // Optional finished frames by pose, possibly shared with a renderer precomputing them
+    std::shared_ptr<FrameCache> poseCache;
+    std::unique_ptr<Renderer> precomputeRenderer;
+    std::thread precomputeThread;
+    std::atomic<bool> isPrecomputeStopped{ false };
+    std::atomic<bool> isPrecomputeDone{ true };
+
+    // Optional hierarchy over each model-space mesh, rebuilt on the first render after the mesh changes
+    bool isHierarchical = false;
+
+    // Setups already rasterized; lets hierarchy traversal rasterize leaf by leaf
+    size_t rasterizedSetups = 0;
+
+    // Optional simplified versions of each mesh, built on the first render after the mesh changes.
+    // Each instance draws the coarsest level whose error projects to at most maxDetailError cells.
+    bool isDetailed = false;
+    float maxDetailError = 0.5f;
+    size_t detailLevel = 0;
+
+    // Mesh of the instance being drawn: its model, and the full mesh or the level of detail picked for it
+    Model* frameMesh = nullptr;
+    unsigned char frameMaterial = 0;
+    const SoAVertexBuffer* frameVertices = nullptr;
+    const SoAVertexBuffer* frameNormals = nullptr;
+    const SoAVertexBuffer* frameVertexNormals = nullptr;
+    const int* frameTriangles = nullptr;
+    unsigned int frameTriangleLength = 0;
+    bool isFrameRigid = true;
     
     Vec3<float> lightDirection = Vec3<float>(0.0f, 0.0f, -1.0f);
     unsigned int lightIntensity = 10;
@@ -66,8 +333,7 @@ public:
         : screenWidth(screenWidth), screenHeight(screenHeight), horizontalScale(horizontalScale), 
           verticalScale(verticalScale), background(background), gradient(gradient), 
           animationDelay(animationDelay), scanStep(scanStep),
-          vertexArray(nullptr), triangleArray(nullptr), normalArray(nullptr),
-          outputBuffer(nullptr), zBuffer(nullptr) {
+          outputBuffer(nullptr), zBuffer(nullptr), presenter(screenWidth, screenHeight) {
 
         if (screenWidth == 0 || screenHeight == 0) {
            throw std::invalid_argument("Renderer Constructor Error: Invalid screen sizes!");
@@ -82,20 +348,26 @@ public:
 
         this->gradientSize = std::strlen(gradient);
 
+        this->models.emplace_back(new Model());
+        this->instances.emplace_back();
+
+        this->coarseDepth.attach(this->zBuffer, 0, 0, screenWidth, screenHeight, screenWidth);
+        markAllDirty();
         resetBuffers();
     }
 
     ~Renderer() {
-        delete[] this->vertexArray;
-        delete[] this->triangleArray;
-        delete[] this->normalArray;
+        stopPrecompute();
+        freeAligned(this->faceLightArray);
+        freeAligned(this->vertexLightArray);
 
-        delete[] this->outputBuffer;
-        delete[] this->zBuffer;
+        if (this->ownsBuffers) {
+            delete[] this->outputBuffer;
+            delete[] this->zBuffer;
+        }
 
-        vertexArray = nullptr;
-        triangleArray = nullptr;
-        normalArray = nullptr;
+        faceLightArray = nullptr;
+        vertexLightArray = nullptr;
         outputBuffer = nullptr;
         zBuffer = nullptr;
     }
@@ -105,17 +377,11 @@ public:
             throw std::invalid_argument("Renderer Vertex Error: Invalid vertex array!");
         }
 
-        if (this->vertexArray != nullptr) {
-            delete[] this->vertexArray;
-        }
-
-        this->lengthOfVertexArray = lengthOfVertexArray;
-        this->vertexArray = new Vec3<float>[lengthOfVertexArray];
-        for (int i = 0; i < lengthOfVertexArray; i++) {
-            this->vertexArray[i] = vertexArray[i];
-        }
+        Model& model = *this->models[0];
+        model.vertexStream.load(vertexArray, lengthOfVertexArray);
+        model.lengthOfVertexArray = lengthOfVertexArray;
 
-        this->isFirstRender = true;
+        invalidateModel(0);
     }
     
     void triangle(const unsigned int& lengthOfTriangleArray, int* triangleArray) {
@@ -123,35 +389,177 @@ public:
             throw std::invalid_argument("Renderer Triangle Error: Invalid triangle array!");
         }
         
-        if (this->triangleArray != nullptr) {
-            delete[] this->triangleArray;
-        }
-        
-        this->lengthOfTriangleArray = lengthOfTriangleArray;
-        this->triangleArray = new int[lengthOfTriangleArray];
-        for (int i = 0; i < lengthOfTriangleArray; i++) {
-            this->triangleArray[i] = triangleArray[i];
-        }
+        Model& model = *this->models[0];
+        model.ownedTriangles.assign(triangleArray, triangleArray + lengthOfTriangleArray);
+        model.lengthOfTriangleArray = lengthOfTriangleArray;
+        model.triangleArray = model.ownedTriangles.data();
 
-        this->isFirstRender = true;
+        invalidateModel(0);
     }
 
     void normal(const unsigned int& lengthOfNormalArray, Vec3<float>* normalArray ) {
-        if (lengthOfNormalArray == 0 || this->lengthOfTriangleArray / lengthOfNormalArray != 3 || normalArray == nullptr) {
+        Model& model = *this->models[0];
+        if (lengthOfNormalArray == 0 || model.lengthOfTriangleArray / lengthOfNormalArray != 3 || normalArray == nullptr) {
             throw std::invalid_argument("Renderer Normal Error: Invalid normal array!");
         }
         
-        if (this->normalArray != nullptr) {
-            delete[] this->normalArray;
+        model.ownedNormals.assign(normalArray, normalArray + lengthOfNormalArray);
+        model.lengthOfNormalArray = lengthOfNormalArray;
+        model.normalArray = model.ownedNormals.data();
+        model.hasUserNormals = true;
+        model.hasNormalView = false;
+
+        invalidateModel(0);
+    }
+
+    // Non-owning variants of vertex(), triangle() and normal(): nothing is copied, so the arrays must
+    // outlive the renderer's use of them. Float arrays must be SIMD_ALIGNMENT aligned and readable up
+    // to paddedLength(length), as in a MappedMesh.
+    void vertexView(unsigned int length, const float* x, const float* y, const float* z) {
+        if (length == 0 || x == nullptr || y == nullptr || z == nullptr) {
+            throw std::invalid_argument("Renderer Vertex Error: Invalid vertex view!");
         }
-        
-        this->lengthOfNormalArray = lengthOfNormalArray;
-        this->normalArray = new Vec3<float>[lengthOfNormalArray];
-        for (int i = 0; i < lengthOfNormalArray; i++) {
-            this->normalArray[i] = normalArray[i];
+
+        Model& model = *this->models[0];
+        model.vertexStream.view(x, y, z, length);
+        model.lengthOfVertexArray = length;
+
+        invalidateModel(0);
+    }
+
+    void triangleView(unsigned int length, const int* triangleArray) {
+        if (length == 0 || length % 3 != 0 || triangleArray == nullptr) {
+            throw std::invalid_argument("Renderer Triangle Error: Invalid triangle view!");
+        }
+
+        Model& model = *this->models[0];
+        model.ownedTriangles.clear();
+        model.lengthOfTriangleArray = length;
+        model.triangleArray = triangleArray;
+
+        invalidateModel(0);
+    }
+
+    void normalView(unsigned int length, const float* x, const float* y, const float* z) {
+        if (length == 0 || x == nullptr || y == nullptr || z == nullptr) {
+            throw std::invalid_argument("Renderer Normal Error: Invalid normal view!");
         }
 
+        Model& model = *this->models[0];
+        model.normalStream.view(x, y, z, length);
+        model.lengthOfNormalArray = length;
+        model.normalArray = nullptr;
+        model.hasUserNormals = true;
+        model.hasNormalView = true;
+
+        invalidateModel(0);
+    }
+
+    // Takes over a loaded mesh without copying it. Face normals are derived on first render.
+    void mesh(Mesh&& mesh) {
+        this->models[0]->load(std::move(mesh));
+        invalidateModel(0);
+    }
+
+    // Renders straight out of a mapped binary mesh, including its precomputed face normals.
+    // The MappedMesh must stay alive while this renderer uses it.
+    void mesh(const MappedMesh& mesh) {
+        this->models[0]->load(mesh);
+        invalidateModel(0);
+    }
+
+    // Adds a mesh for addInstance() to draw, without drawing it, and returns its model id
+    unsigned int addModel(Mesh&& mesh) {
+        std::unique_ptr<Model> model(new Model());
+        model->load(std::move(mesh));
+        this->models.push_back(std::move(model));
         this->isFirstRender = true;
+        return (unsigned int)this->models.size() - 1;
+    }
+
+    // As addModel(Mesh&&), borrowing a mapped binary mesh that must outlive its use
+    unsigned int addModel(const MappedMesh& mesh) {
+        std::unique_ptr<Model> model(new Model());
+        model->load(mesh);
+        this->models.push_back(std::move(model));
+        this->isFirstRender = true;
+        return (unsigned int)this->models.size() - 1;
+    }
+
+    // Draws the model once more with its own transform, sharing the model's vertices, triangles,
+    // normals and everything derived from them. Returns the instance id.
+    unsigned int addInstance(unsigned int model, const Mat4<float>& transform = Mat4<float>()) {
+        if (model >= this->models.size()) {
+            throw std::invalid_argument("Renderer Instance Error: Invalid model!");
+        }
+
+        Instance instance;
+        instance.model = model;
+        instance.place(transform);
+        this->instances.push_back(instance);
+        this->isDrawOrderStale = true;
+        changeScene();
+        return (unsigned int)this->instances.size() - 1;
+    }
+
+    void instanceTransform(unsigned int instance, const Mat4<float>& transform) {
+        instanceTransforms(instance, 1, &transform);
+    }
+
+    // Moves count consecutive instances starting at first in one call
+    void instanceTransforms(unsigned int first, unsigned int count, const Mat4<float>* transforms) {
+        if ((size_t)first + count > this->instances.size() || (count > 0 && transforms == nullptr)) {
+            throw std::invalid_argument("Renderer Instance Error: Invalid instance range!");
+        }
+
+        for (unsigned int i = 0; i < count; i++) {
+            this->instances[first + i].place(transforms[i]);
+        }
+        changeScene();
+    }
+
+    void instanceVisible(unsigned int instance, bool isVisible) {
+        if (instance >= this->instances.size()) {
+            throw std::invalid_argument("Renderer Instance Error: Invalid instance!");
+        }
+        this->instances[instance].isVisible = isVisible;
+        changeScene();
+    }
+
+    // Color of the instance's cells with colorOutput(), as 0xRRGGBB at full light. Up to 256
+    // different colors can be in use; every instance starts white.
+    void instanceColor(unsigned int instance, uint32_t rgb) {
+        if (instance >= this->instances.size()) {
+            throw std::invalid_argument("Renderer Instance Error: Invalid instance!");
+        }
+
+        rgb &= 0xFFFFFF;
+        size_t slot = std::find(this->instanceColors.begin(), this->instanceColors.end(), rgb) - this->instanceColors.begin();
+        if (slot == this->instanceColors.size()) {
+            if (slot == 256) {
+                throw std::invalid_argument("Renderer Color Error: Too many instance colors!");
+            }
+            this->instanceColors.push_back(rgb);
+            buildShadeTable();
+        }
+        this->instances[instance].material = (unsigned char)slot;
+        changeScene();
+    }
+
+    // Drops every model and instance added by addModel() and addInstance()
+    void clearScene() {
+        this->models.resize(1);
+        this->instances.resize(1);
+        this->isDrawOrderStale = true;
+        changeScene();
+    }
+
+    size_t modelCount() const {
+        return this->models.size();
+    }
+
+    size_t instanceCount() const {
+        return this->instances.size();
     }
 
     void light(float distanceFromCam, const Vec3<float>& lightDirection, int lightIntensity) {
@@ -171,128 +579,1678 @@ public:
         this->translateDirection = translateDirection;
     }
 
-    void render() {
-        if (this->isFirstRender) {
-            handleFirstRender();
+    // Any chain of rotations, translations and scales, composed by the caller into one matrix.
+    // Applies to instance 0; see instanceTransform() for the others.
+    void transform(const Mat4<float>& modelTransform) {
+        this->instances[0].place(modelTransform);
+        changeScene();
+    }
+
+    void rasterizer(RasterMode rasterMode) {
+        this->rasterMode = rasterMode;
+        changeScene();
+    }
+
+    // ShadingMode::Smooth derives vertex normals on the next render and turns the flat facets of
+    // curved meshes into gradients, at about the cost of flat shading per cell. Cells where the
+    // interpolated light reaches 0 are left undrawn, as unlit triangles are with flat shading.
+    void shading(ShadingMode shadingMode) {
+        if (shadingMode != this->shadingMode) {
+            this->shadingMode = shadingMode;
+            invalidateModels();
+        }
+    }
+
+    // Drops triangles whose transformed normal points away from the camera. Off by default, since
+    // the inside of open meshes such as the heart shows through their gaps; enable it for closed meshes.
+    void backFaceCulling(bool isEnabled) {
+        this->isBackFaceCulling = isEnabled;
+        changeScene();
+    }
+
+    // Walks a BVH instead of every triangle, skipping whole subtrees outside the view or hidden behind
+    // nearer geometry, nearest first. Pays off for large meshes; the hierarchy is built on the next
+    // render, in parallel when threads() is set. Occlusion needs an up-to-date z-buffer, so with
+    // RasterMode::ScreenSpace on several threads only the frustum test applies. Triangles may be
+    // drawn in a different order, which only matters for cells where two of them have equal depth.
+    void hierarchy(bool isEnabled) {
+        this->isHierarchical = isEnabled;
+        invalidateModels();
+    }
+
+    // Tests triangles against the coarse depth buffer before rasterizing or scanning them, rejecting
+    // those hidden behind what is already drawn, or skipping their hidden blocks. Pays off when
+    // many triangles overlap and nearer ones come first, as with hierarchy(); with little overdraw
+    // the tests cost more than they save. Output is unchanged.
+    void earlyDepthTest(bool isEnabled) {
+        if (isEnabled && !this->isEarlyDepthTest) {
+            this->coarseDepth.invalidate(0, 0, this->screenWidth, this->screenHeight);
+        }
+        this->isEarlyDepthTest = isEnabled;
+    }
+
+    // Draws simplified versions of the mesh when it is small on screen: the coarsest level whose
+    // error, projected at the mesh's nearest depth, stays within maxError cells. Levels are built by
+    // quadric edge collapse on the next render, each with about half the triangles of the one
+    // before, so triangle count follows screen size. Coarser levels use face normals derived from
+    // their own triangles; the hierarchy only covers the full mesh.
+    void levelOfDetail(bool isEnabled, float maxError = 0.5f) {
+        if (isEnabled && !(maxError > 0)) {
+            throw std::invalid_argument("Renderer Level Of Detail Error: Invalid maximum error!");
         }
 
-        for (int i = 0; i < this->lengthOfTriangleArray; i += 3) {
-            Vec3<float> v0 = this->vertexArray[this->triangleArray[i]];
-            Vec3<float> v1 = this->vertexArray[this->triangleArray[i + 1]];
-            Vec3<float> v2 = this->vertexArray[this->triangleArray[i + 2]];
+        this->isDetailed = isEnabled;
+        this->maxDetailError = maxError;
+        invalidateModels();
+    }
+
+    // Levels of detail of model 0, including the full mesh
+    size_t detailLevels() const {
+        return this->models[0]->lods.size();
+    }
+
+    // Level drawn for the last instance of the last frame; 0 is the full mesh
+    size_t currentDetailLevel() const {
+        return this->detailLevel;
+    }
+
+    // Hierarchy of model 0
+    const Bvh& boundingVolumes() const {
+        return this->models[0]->bvh;
+    }
+
+    // Counters of the last rendered frame
+    CullStats cullStats() const {
+        return this->cullCounters;
+    }
+
+    // Timers and counters of the last complete frame. All zero unless RENDERER_INSTRUMENTATION is
+    // defined before this header is included.
+    FrameStats frameStats() const {
+#ifdef RENDERER_INSTRUMENTATION
+        return this->lastStatistics;
+#else
+        return FrameStats();
+#endif
+    }
+
+    StageTimes frameTimes() const {
+        return frameStats().times;
+    }
+
+    // Overwrites the bottom row of every frame with frameStats() of the frame before it, so the line
+    // is also part of characterPlane(). Draws nothing without RENDERER_INSTRUMENTATION.
+    void statusLine(bool isEnabled) {
+        this->isStatusLine = isEnabled;
+    }
 
-            v0.rotate(this->thetaX, this->thetaY, this->thetaZ);
-            v1.rotate(this->thetaX, this->thetaY, this->thetaZ);
-            v2.rotate(this->thetaX, this->thetaY, this->thetaZ);
+    // Calls draw on every rendered frame after the scene, the status line and the colors, so text it
+    // puts down with drawText() is part of the frame and goes out in the same write. nullptr removes it.
+    void overlay(std::function<void(Renderer&)> draw) {
+        this->overlayCallback = std::move(draw);
+    }
 
-            v0 += this->translateDirection;
-            v1 += this->translateDirection;
-            v2 += this->translateDirection;
+    // Writes length characters of text from column x of row y, clipped to the screen, and with
+    // colorOutput() colors them rgb. Meant for overlay(): anything drawn before render() is drawn over
+    // by the scene and recolored as part of it.
+    void drawText(int x, int y, const char* text, size_t length, uint32_t rgb = TEXT_COLOR) {
+        if (y < 0 || y >= (int)this->screenHeight || x >= (int)this->screenWidth) {
+            return;
+        }
+        long long first = std::max(x, 0);
+        long long last = std::min((long long)x + (long long)length, (long long)this->screenWidth);
+        if (first >= last) {
+            return;
+        }
 
-            renderTriangle(v0, v1, v2, i / 3);
+        size_t index = first + (size_t)y * this->screenWidth;
+        size_t count = last - first;
+        std::memcpy(this->outputBuffer + index, text + (first - x), count);
+        if (this->materialPlane != nullptr) {
+            std::memset(this->materialPlane + index, 0, count);
+            std::fill_n(this->cellColors.data() + index, count, rgb);
         }
+        this->dirtyBounds.add((int)first, y, (int)last - 1, y);
+    }
 
-        printBuffer();
-        this->thetaX += this->angleX;
-        this->thetaY += this->angleY;
-        this->thetaZ += this->angleZ;
+    // Overrides the runtime CPU detection, e.g. to compare against the scalar fallback
+    void kernelSet(VertexKernelSet set) {
+        this->kernels = selectVertexKernels(set);
+    }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(this->animationDelay));
+    const char* kernelName() const {
+        return this->kernels.name;
     }
 
-    void resetBuffers() {
-        for (int y = 0; y < this->screenHeight; y++) {
-            for (int x = 0; x < this->screenWidth; x++) {
-                int index = x + y * this->screenWidth;
-                this->outputBuffer[index] = this->background;
-                this->zBuffer[index] = 0;
-            }
+    // Sizes the frame arena up front. Without it the arena grows on the first frames, and again
+    // whenever a frame needs more than any before it. Other than that, and preparing models after
+    // they change, render() does not allocate.
+    void reserveFrameMemory(size_t bytes) {
+        this->frameArena.reset();
+        this->frameArena.reserve(bytes);
+    }
+
+    const FrameArena& frameMemory() const {
+        return this->frameArena;
+    }
+
+    // Threads used by RasterMode::ScreenSpace, including the caller; 0 picks one per hardware thread.
+    // Output is identical for every thread count.
+    void threads(unsigned int threadCount) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        if (threadCount == 1) {
+            this->threadPool.reset();
+            return;
+        }
+
+        this->threadPool.reset(new ThreadPool(threadCount));
+        this->tilesX = (this->screenWidth + TILE_WIDTH - 1) / TILE_WIDTH;
+        this->tilesY = (this->screenHeight + TILE_HEIGHT - 1) / TILE_HEIGHT;
+        this->tileOutputBuffer.assign(threadCount * TILE_AREA, this->background);
+        this->tileZBuffer.assign(threadCount * TILE_AREA, 0);
+        this->tileMaterialBuffer.assign(threadCount * TILE_AREA, 0);
+        this->tileCoarseDepth.assign(threadCount, CoarseDepthBuffer());
+        for (unsigned int worker = 0; worker < threadCount; worker++) {
+            // Sized for a whole tile now, so attaching to tiles while rendering never allocates
+            this->tileCoarseDepth[worker].attach(&this->tileZBuffer[worker * TILE_AREA], 0, 0, TILE_WIDTH, TILE_HEIGHT, TILE_WIDTH);
         }
+        INSTRUMENT(this->tileSamples.assign(threadCount, SampleCounters());)
     }
 
-    void printBuffer() {
-        std::string output;
-        output.reserve(this->screenArea + this->screenHeight);
-        
-        for (int y = 0; y < this->screenHeight; y++) {
-            for (int x = 0; x < this->screenWidth; x++) {
-                output += this->outputBuffer[x + y * this->screenWidth];
+    // With diff output enabled, printBuffer only rewrites the cells that changed since the last frame
+    void diffOutput(bool isEnabled) {
+        this->isDiffOutput = isEnabled;
+        this->presenter.diff(isEnabled);
+        if (this->asyncPresenter) {
+            this->asyncPresenter->diff(isEnabled);
+        }
+    }
+
+    // Gives every cell the color of its instance, see instanceColor(), dimmed to its light level, in
+    // place of the single color set on the terminal. The gradient is split into levels bands of one
+    // brightness each; the characters still show every light level, and fewer bands mean longer runs
+    // of one color. Color sequences are only written where the color changes along what is written,
+    // and presentStats() counts their bytes. colorPlane() holds the colors, in headless mode too.
+    void colorOutput(ColorMode colorMode, unsigned int levels = 2) {
+        if (levels == 0) {
+            throw std::invalid_argument("Renderer Color Error: Invalid color levels!");
+        }
+
+        this->colorMode = colorMode;
+        this->colorLevels = levels;
+        if (colorMode == ColorMode::Monochrome) {
+            std::vector<unsigned char>().swap(this->materials);
+            std::vector<uint32_t>().swap(this->cellColors);
+            this->materialPlane = nullptr;
+        } else {
+            if (this->materialPlane == nullptr) {
+                this->materials.assign(this->screenArea, 0);
+                this->materialPlane = this->materials.data();
             }
-            output += '\n';
+            buildShadeTable();
+            this->cellColors.assign(this->screenArea, this->shadeTable[(unsigned char)this->background]);
+            markAllDirty();
         }
 
-        std::cout << "\x1b[H" << output;
+        this->presenter.colors(colorMode);
+        if (this->asyncPresenter) {
+            this->asyncPresenter->colors(colorMode);
+        }
+        changeScene();
     }
 
-private:
-    void handleFirstRender() {
-        if (this->vertexArray == nullptr) {
-            throw std::runtime_error("Unintialized Vertex Array: Try using vertex() before rendering");
-        } else if (this->triangleArray == nullptr) {
-            throw std::runtime_error("Unintialized Triangle Array: Try using triangle() before rendering");
-        } else if (this->normalArray == nullptr) {
-            normalArray = new Vec3<float>[this->lengthOfTriangleArray / 3];
+    // Call after writing anything else to the terminal, so the next frame is fully repainted
+    void invalidateScreen() {
+        this->presenter.invalidate();
+        if (this->asyncPresenter) {
+            this->asyncPresenter->invalidate();
+        }
+    }
 
-            for (int i = 0; i < this->lengthOfTriangleArray; i+= 3) {
-                Vec3<float> v0 = vertexArray[this->triangleArray[i]];
-                Vec3<float> v1 = vertexArray[this->triangleArray[i + 1]];
-                Vec3<float> v2 = vertexArray[this->triangleArray[i + 2]];
+    PresentStats presentStats() const {
+        return this->asyncPresenter ? this->asyncPresenter->getStats() : this->presenter.getStats();
+    }
 
-                normal(v0, v1, v2, i / 3);
-            }
+    // Splits rendering into a compute stage on the caller's thread and a present stage on a
+    // dedicated thread, so terminal writes overlap the next frame. When the terminal cannot keep
+    // up with the render loop, frames are dropped instead of blocking it.
+    void asyncOutput(bool isEnabled) {
+        if (!isEnabled) {
+            this->asyncPresenter.reset();
+            this->presenter.invalidate();
+            return;
         }
 
-        this->isFirstRender = false;
+        if (!this->asyncPresenter) {
+            startAsyncPresenter();
+        }
     }
 
-    void normal(const Vec3<float>& v0, const Vec3<float>& v1, const Vec3<float>& v2, const int& triangleId) {        
-        if (this->normalArray == nullptr) {
-            this->normalArray = new Vec3<float>[this->lengthOfTriangleArray / 3];
-        } 
+    // Writes frames to output, e.g. an FdOutput, in place of std::cout; nullptr goes back to std::cout.
+    // While the output is backed up, render() drops frames without drawing them, so the loop never
+    // waits on a slow terminal or pipe. See isOutputBlocked().
+    void output(std::shared_ptr<OutputBackend> output) {
+        flush();
+        this->outputBackend = std::move(output);
+        this->presenter.invalidate();
+        if (this->asyncPresenter) {
+            startAsyncPresenter();
+        }
+    }
 
-        this->normalArray[triangleId] = (v1 - v0) ^ (v2 - v1);
-        this->normalArray[triangleId].normalize();
+    // True when a frame rendered now could not be written without waiting: the output backend is
+    // backed up or, with asyncOutput(), every slot of the presenter thread is still queued.
+    // render() checks this itself; loops may check it to skip their own per-frame work too.
+    bool isOutputBlocked() {
+        if (this->isHeadless) {
+            return false;
+        }
+        if (this->asyncPresenter) {
+            return this->asyncPresenter->pending() >= AsyncPresenter::SLOT_COUNT;
+        }
+        return this->outputBackend && !this->outputBackend->ready();
     }
 
-    void setPixel(int x, int y, char color) {
-        if (x >= 0 && x < this->screenWidth && y >= 0 && y < this->screenHeight) {
-            this->outputBuffer[x + y * this->screenWidth] = color;
+    // Blocks until every frame handed to the presenter thread is on the terminal
+    void flush() {
+        if (this->asyncPresenter) {
+            this->asyncPresenter->flush();
+        }
+        if (this->outputBackend) {
+            this->outputBackend->flush();
+        } else {
+            std::cout.flush();
         }
     }
 
-    void renderTriangle(Vec3<float>& v0, Vec3<float>& v1, Vec3<float>& v2, const int& normalId) {
-        Triangle<float> triangle(v0, v1, v2);
-        Vec3<float> normal(this->normalArray[normalId]);
-        normal.rotate(this->thetaX, this->thetaY, this->thetaZ);
+    // Frames render() skipped for isOutputBlocked(), plus those the presenter thread dropped
+    unsigned long long droppedFrames() const {
+        return this->blockedFrames + (this->asyncPresenter ? this->asyncPresenter->dropped() : 0);
+    }
 
-        float minX = std::min(v0.x, std::min(v1.x, v2.x));
-        float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+    // Paces render() to targetFps instead of sleeping animationDelay after every frame. The angles
+    // given to rotation() then mean radians per target frame and are scaled by the real frame time,
+    // so animation speed no longer depends on how long a frame takes. With skipFrames, a loop that
+    // falls behind drops whole frames to catch up. A targetFps of 0 restores the fixed delay.
+    void frameRate(float targetFps, bool skipFrames = false) {
+        this->isGoverned = targetFps > 0;
+        if (this->isGoverned) {
+            this->governor.target(targetFps, skipFrames);
+        }
+    }
 
-        float minY = std::min(v0.y, std::min(v1.y, v2.y));
-        float maxY = std::max(v0.y, std::max(v1.y, v2.y));
+    const FrameGovernor& pacing() const {
+        return this->governor;
+    }
 
-        for (float x = minX; x < maxX; x += scanStep) {
-            for (float y = minY; y < maxY; y += scanStep) {
-                Vec3<float> vertex(x, y, triangle.getZFrom(x, y));
+    // Renders offscreen: render() only fills the buffers, never touching the terminal, sleeping or
+    // pacing, and the animation advances by the rotation() angles once per call. Frames are read
+    // back through characterPlane(), depthPlane() and lightPlane(), e.g. to feed a FrameWriter.
+    void headless(bool isEnabled) {
+        this->isHeadless = isEnabled;
+    }
 
-                if (triangle.containsVertex(vertex)) {
-                    projectVertex(vertex, normal);
+    // Looks every frame up by its pose (rotation, translation, light and screen size) before drawing
+    // it: a hit copies the stored characters into the frame without transforming or rasterizing
+    // anything, a miss draws and stores it. Poses are snapped to the cache's grid, so all frames under
+    // a key are the same. Assumes resetBuffers() before every render(); hits leave depthPlane() and
+    // lightPlane() as they were. Changing the scene clears the cache, and nullptr detaches it.
+    void frameCache(std::shared_ptr<FrameCache> cache) {
+        stopPrecompute();
+        this->poseCache = std::move(cache);
+    }
+
+    // Fills the frame cache on a background thread while this renderer keeps rendering. renderer
+    // must draw the same scene as this one and gets the cache attached; for each of the frames, pose
+    // moves it to the next pose with translation() or light(), and it renders headless, advancing by
+    // its rotation() angles. One full cycle of a looping animation makes every later frame a hit.
+    void precompute(std::unique_ptr<Renderer> renderer, unsigned int frames, std::function<void(Renderer&, unsigned int)> pose = nullptr) {
+        if (!this->poseCache) {
+            throw std::invalid_argument("Renderer Precompute Error: No frame cache!");
+        }
+        if (!renderer || renderer->screenWidth != this->screenWidth || renderer->screenHeight != this->screenHeight) {
+            throw std::invalid_argument("Renderer Precompute Error: Invalid renderer!");
+        }
+
+        stopPrecompute();
+        this->precomputeRenderer = std::move(renderer);
+        this->precomputeRenderer->frameCache(this->poseCache);
+        this->precomputeRenderer->headless(true);
+        this->isPrecomputeStopped = false;
+        this->isPrecomputeDone = false;
+
+        this->precomputeThread = std::thread([this, frames, pose] {
+            Renderer& renderer = *this->precomputeRenderer;
+            for (unsigned int frame = 0; frame < frames && !this->isPrecomputeStopped; frame++) {
+                if (pose) {
+                    pose(renderer, frame);
                 }
+                renderer.resetBuffers();
+                renderer.render();
             }
+            this->isPrecomputeDone = true;
+        });
+    }
+
+    bool isPrecomputing() const {
+        return !this->isPrecomputeDone;
+    }
+
+    // Abandons precompute() early; the frames it stored so far stay in the cache
+    void stopPrecompute() {
+        if (this->precomputeThread.joinable()) {
+            this->isPrecomputeStopped = true;
+            this->precomputeThread.join();
         }
+        this->precomputeRenderer.reset();
+        this->isPrecomputeDone = true;
     }
 
-    void projectVertex(const Vec3<float>& vertex, const Vec3<float>& normal) {
-        float ooz = 1 / (vertex.z + this->distanceFromCam);
-        int xp = (int)((this->screenWidth / 2) + (this->horizontalScale * vertex.x * ooz));
-        int yp = (int)((this->screenHeight / 2) - (this->verticalScale * vertex.y * ooz));
-        int index = xp + yp * this->screenWidth;
+    // Renders into caller memory of screenWidth * screenHeight cells each, row by row, instead of
+    // the renderer's own buffers. The memory must outlive its use; passing two nullptrs switches
+    // back to the renderer's own buffers. Call resetBuffers() before rendering into new memory.
+    void frameBuffers(char* characters, float* depths) {
+        if ((characters == nullptr) != (depths == nullptr)) {
+            throw std::invalid_argument("Renderer Frame Buffer Error: Invalid frame buffers!");
+        }
 
-        float L = (normal) * this->lightDirection;
-        if (ooz > this->zBuffer[index] && L > 0) {
-            this->zBuffer[index] = ooz;
-            int lightLevel = std::min((float)this->gradientSize - 1, L * this->lightIntensity);
-            setPixel(xp, yp, this->gradient[lightLevel]);
+        if (this->ownsBuffers) {
+            delete[] this->outputBuffer;
+            delete[] this->zBuffer;
+        }
+
+        this->ownsBuffers = characters == nullptr;
+        this->outputBuffer = this->ownsBuffers ? new char[this->screenArea] : characters;
+        this->zBuffer = this->ownsBuffers ? new float[this->screenArea] : depths;
+        this->coarseDepth.attach(this->zBuffer, 0, 0, this->screenWidth, this->screenHeight, this->screenWidth);
+        markAllDirty();
+        if (this->ownsBuffers) {
+            resetBuffers();
+        }
+    }
+
+    // The last frame, row by row: one gradient or background character per cell
+    const char* characterPlane() const {
+        return this->outputBuffer;
+    }
+
+    // 0xRRGGBB per cell with colorOutput(), nullptr without
+    const uint32_t* colorPlane() const {
+        return this->materialPlane != nullptr ? this->cellColors.data() : nullptr;
+    }
+
+    // 1/z of the nearest surface per cell, 0 where nothing was drawn
+    const float* depthPlane() const {
+        return this->zBuffer;
+    }
+
+    // Writes the gradient index of every cell to levels, or NO_LIGHT for the background. Levels are
+    // recovered from the characters, so a character repeated in the gradient reads as its first use.
+    void lightPlane(unsigned char* levels) const {
+        unsigned char lookup[256];
+        std::memset(lookup, NO_LIGHT, sizeof(lookup));
+        for (unsigned int i = this->gradientSize; i-- > 0;) {
+            lookup[(unsigned char)this->gradient[i]] = (unsigned char)i;
+        }
+        for (unsigned int i = 0; i < this->screenArea; i++) {
+            levels[i] = this->zBuffer[i] > 0 ? lookup[(unsigned char)this->outputBuffer[i]] : NO_LIGHT;
+        }
+    }
+
+    unsigned int getWidth() const {
+        return this->screenWidth;
+    }
+
+    unsigned int getHeight() const {
+        return this->screenHeight;
+    }
+
+    void render() {
+        if (this->isFirstRender) {
+            handleFirstRender();
+        }
+
+        bool isPaced = this->isGoverned && !this->isHeadless;
+        if (isPaced) {
+            float frames = this->governor.beginFrame() * this->governor.getTargetFps();
+            this->thetaX += this->angleX * frames;
+            this->thetaY += this->angleY * frames;
+            this->thetaZ += this->angleZ * frames;
+
+            if (this->governor.shouldSkip()) {
+                this->governor.skipFrame();
+                return;
+            }
+        }
+
+        if (isOutputBlocked()) {
+            this->blockedFrames++;
+        } else {
+            drawFrame();
+        }
+
+        if (isPaced) {
+            INSTRUMENT_SCOPE(this->statistics.times.sleep);
+            this->governor.endFrame();
+        } else {
+            this->thetaX += this->angleX;
+            this->thetaY += this->angleY;
+            this->thetaZ += this->angleZ;
+
+            if (!this->isHeadless) {
+                INSTRUMENT_SCOPE(this->statistics.times.sleep);
+                std::this_thread::sleep_for(std::chrono::milliseconds(this->animationDelay));
+            }
+        }
+        INSTRUMENT(this->lastStatistics = this->statistics;)
+    }
+
+    // Clears only the cells written since the last call, row by row or in one fill when they span
+    // whole rows. Depth 0 is all zero bits, so both planes are cleared with memset.
+    void resetBuffers() {
+        const ScreenRect& dirty = this->dirtyBounds;
+        if (!dirty.empty()) {
+            size_t width = dirty.maxX - dirty.minX + 1;
+            size_t rows = dirty.maxY - dirty.minY + 1;
+            size_t first = dirty.minX + (size_t)dirty.minY * this->screenWidth;
+            if (width == this->screenWidth) {
+                std::memset(this->outputBuffer + first, this->background, width * rows);
+                std::memset(this->zBuffer + first, 0, width * rows * sizeof(float));
+            } else {
+                for (size_t y = 0; y < rows; y++) {
+                    std::memset(this->outputBuffer + first + y * this->screenWidth, this->background, width);
+                    std::memset(this->zBuffer + first + y * this->screenWidth, 0, width * sizeof(float));
+                }
+            }
+
+            if (this->materialPlane != nullptr) {
+                uint32_t color = this->shadeTable[(unsigned char)this->background];
+                for (size_t y = 0; y < rows; y++) {
+                    std::memset(this->materialPlane + first + y * this->screenWidth, 0, width);
+                    std::fill_n(this->cellColors.data() + first + y * this->screenWidth, width, color);
+                }
+            }
+        }
+        this->coarseDepth.clear(0);
+        this->dirtyBounds = ScreenRect();
+    }
+
+    // Cells written since the last resetBuffers(); all others hold the background
+    ScreenRect dirtyRect() const {
+        return this->dirtyBounds;
+    }
+
+    // Only rows holding more than the background are compared against the displayed frame
+    void printBuffer() {
+        const ScreenRect& dirty = this->dirtyBounds;
+        unsigned int rowBegin = dirty.empty() ? 0 : dirty.minY;
+        unsigned int rowEnd = dirty.empty() ? 0 : dirty.maxY + 1;
+        if (this->asyncPresenter) {
+            this->asyncPresenter->submit(this->outputBuffer, colorPlane(), rowBegin, rowEnd);
+        } else if (this->outputBackend) {
+            this->presenter.present(this->outputBuffer, colorPlane(), rowBegin, rowEnd, *this->outputBackend);
+        } else {
+            this->presenter.present(this->outputBuffer, colorPlane(), rowBegin, rowEnd);
+        }
+    }
+
+private:
+    // Draws the scene, or copies it from the frame cache, puts the status line, colors and overlays
+    // over it and presents it
+    void drawFrame() {
+        this->cullCounters = CullStats();
+        INSTRUMENT(this->statistics = FrameStats();)
+
+        if (this->poseCache) {
+            PoseKey key = poseKey();
+            if (this->poseCache->find(key, this->outputBuffer, this->materialPlane, this->screenArea)) {
+                markAllDirty();
+            } else {
+                drawScene();
+                this->poseCache->insert(key, this->outputBuffer, this->materialPlane, this->screenArea);
+            }
+        } else {
+            drawScene();
+        }
+
+        if (this->isStatusLine) {
+            INSTRUMENT(drawStatusLine();)
+        }
+        if (this->materialPlane != nullptr) {
+            shadeColors();
+        }
+        if (this->overlayCallback) {
+            this->overlayCallback(*this);
+        }
+
+        if (!this->isHeadless) {
+            INSTRUMENT_SCOPE(this->statistics.times.present);
+            printBuffer();
+            INSTRUMENT(this->statistics.bytesWritten = presentStats().frameBytes;)
+        }
+    }
+
+    // Replaces the presenter thread with one writing to the current output
+    void startAsyncPresenter() {
+        this->asyncPresenter.reset();
+        if (this->outputBackend) {
+            this->asyncPresenter.reset(new AsyncPresenter(this->screenWidth, this->screenHeight, this->outputBackend));
+        } else {
+            this->asyncPresenter.reset(new AsyncPresenter(this->screenWidth, this->screenHeight));
+        }
+        this->asyncPresenter->diff(this->isDiffOutput);
+        this->asyncPresenter->colors(this->colorMode);
+    }
+
+    // Prepares every model that changed since the last render, sizes the per-instance buffers for the
+    // largest model and groups the instances by model
+    void handleFirstRender() {
+        Model& legacy = *this->models[0];
+        if (legacy.empty() && this->instances.size() == 1) {
+            legacy.prepare(this->isHierarchical, this->isDetailed, isSmooth(), this->threadPool.get());
+        }
+
+        size_t vertices = 0, normals = 0;
+        for (std::unique_ptr<Model>& model : this->models) {
+            if (model->empty()) {
+                continue;
+            }
+            if (!model->isPrepared) {
+                model->prepare(this->isHierarchical, this->isDetailed, isSmooth(), this->threadPool.get());
+            }
+            vertices = std::max(vertices, model->vertexStream.length());
+            normals = std::max(normals, model->normalStream.length());
+        }
+
+        this->transformedVertexStream.resize(vertices);
+        this->transformedNormalStream.resize(normals);
+
+        freeAligned(this->faceLightArray);
+        this->faceLightArray = allocateAligned(this->transformedNormalStream.padded());
+
+        freeAligned(this->vertexLightArray);
+        this->vertexLightArray = nullptr;
+        if (isSmooth()) {
+            this->transformedVertexNormalStream.resize(vertices);
+            this->vertexLightArray = allocateAligned(this->transformedVertexStream.padded());
+        }
+
+        this->isFirstRender = false;
+    }
+
+    void invalidateModel(unsigned int model) {
+        this->models[model]->isPrepared = false;
+        this->isFirstRender = true;
+        changeScene();
+    }
+
+    void invalidateModels() {
+        for (std::unique_ptr<Model>& model : this->models) {
+            model->isPrepared = false;
+        }
+        this->isFirstRender = true;
+        changeScene();
+    }
+
+    // Transforms, culls and rasterizes every instance into the frame
+    void drawScene() {
+        if (this->isDrawOrderStale) {
+            sortDrawOrder();
+        }
+
+        this->setupArray.start(this->frameArena, this->lastSetupCount);
+        this->rasterizedSetups = 0;
+
+        if (this->poseCache) {
+            const FrameCache& cache = *this->poseCache;
+            Vec3<float> translation(cache.snapLength(this->translateDirection.x), cache.snapLength(this->translateDirection.y),
+                                    cache.snapLength(this->translateDirection.z));
+            this->sceneTransform = Mat4<float>::translation(translation)
+                                 * Mat4<float>::rotation(cache.snapAngle(this->thetaX), cache.snapAngle(this->thetaY), cache.snapAngle(this->thetaZ));
+        } else {
+            this->sceneTransform = Mat4<float>::translation(this->translateDirection)
+                                 * Mat4<float>::rotation(this->thetaX, this->thetaY, this->thetaZ);
+        }
+
+        for (unsigned int i : this->drawOrder) {
+            if (!beginInstance(this->instances[i])) {
+                continue;
+            }
+
+            if (this->rasterMode == RasterMode::ScreenSpace) {
+                // Traversing a hierarchy can rasterize as it goes, which rasterizeSetups() times itself
+                INSTRUMENT(auto start = std::chrono::steady_clock::now(); double rasterized = this->statistics.times.rasterize;)
+                setupTriangles();
+                INSTRUMENT(this->statistics.times.setup += secondsSince(start) - (this->statistics.times.rasterize - rasterized);)
+            } else {
+                renderTriangles();
+            }
+        }
+
+        if (this->rasterMode == RasterMode::ScreenSpace) {
+            if (this->threadPool) {
+                rasterizeTiles();
+            } else {
+                rasterizeSetups();
+            }
+            this->lastSetupCount = this->setupArray.size();
+        }
+        countDepthRejections();
+
+        // Nothing in the arena outlives rasterization; a first frame that outgrew it resizes it here
+        this->frameArena.reset();
+        INSTRUMENT(countTriangles();)
+    }
+
+    PoseKey poseKey() const {
+        const FrameCache& cache = *this->poseCache;
+        PoseKey key;
+        int32_t* field = key.fields;
+        *field++ = cache.quantizeAngle(this->thetaX);
+        *field++ = cache.quantizeAngle(this->thetaY);
+        *field++ = cache.quantizeAngle(this->thetaZ);
+        *field++ = cache.quantizeLength(this->translateDirection.x);
+        *field++ = cache.quantizeLength(this->translateDirection.y);
+        *field++ = cache.quantizeLength(this->translateDirection.z);
+        *field++ = FrameCache::exact(this->lightDirection.x);
+        *field++ = FrameCache::exact(this->lightDirection.y);
+        *field++ = FrameCache::exact(this->lightDirection.z);
+        *field++ = (int32_t)this->lightIntensity;
+        *field++ = FrameCache::exact(this->distanceFromCam);
+        *field++ = (int32_t)this->screenWidth;
+        *field++ = (int32_t)this->screenHeight;
+        return key;
+    }
+
+    // Every instance color at every gradient level, the brightest band at full color; a character
+    // repeated in the gradient takes the level of its first use, as in lightPlane()
+    void buildShadeTable() {
+        unsigned int bands = std::min(this->colorLevels, this->gradientSize);
+        this->shadeTable.assign(this->instanceColors.size() * 256, TEXT_COLOR);
+        for (size_t slot = 0; slot < this->instanceColors.size(); slot++) {
+            uint32_t rgb = this->instanceColors[slot];
+            for (unsigned int i = this->gradientSize; i-- > 0;) {
+                float light = (float)(i * bands / this->gradientSize + 1) / bands;
+                uint32_t color = 0;
+                for (int shift = 16; shift >= 0; shift -= 8) {
+                    color |= (uint32_t)std::lround(((rgb >> shift) & 0xFF) * light) << shift;
+                }
+                this->shadeTable[slot * 256 + (unsigned char)this->gradient[i]] = color;
+            }
+        }
+    }
+
+    // Colors the cells written since the last resetBuffers()
+    void shadeColors() {
+        const ScreenRect& dirty = this->dirtyBounds;
+        if (dirty.empty()) {
+            return;
+        }
+        for (int y = dirty.minY; y <= dirty.maxY; y++) {
+            for (int x = dirty.minX; x <= dirty.maxX; x++) {
+                int index = x + y * this->screenWidth;
+                this->cellColors[index] = this->shadeTable[this->materialPlane[index] * 256 + (unsigned char)this->outputBuffer[index]];
+            }
+        }
+    }
+
+    // The whole frame may hold something other than the background
+    void markAllDirty() {
+        this->dirtyBounds.add(0, 0, this->screenWidth - 1, this->screenHeight - 1);
+    }
+
+    // Cached frames no longer match what the scene would draw
+    void changeScene() {
+        if (this->poseCache) {
+            stopPrecompute();
+            this->poseCache->clear();
+        }
+    }
+
+    // Instances by model, in the order they were added within each model
+    void sortDrawOrder() {
+        this->drawOrder.resize(this->instances.size());
+        for (unsigned int i = 0; i < this->drawOrder.size(); i++) {
+            this->drawOrder[i] = i;
+        }
+        std::stable_sort(this->drawOrder.begin(), this->drawOrder.end(), [this](unsigned int a, unsigned int b) {
+            return this->instances[a].model < this->instances[b].model;
+        });
+        this->isDrawOrderStale = false;
+    }
+
+    // Points the frame at the instance's model and transforms it. False when there is nothing to
+    // draw: the instance is hidden, its model has no mesh, or its bounds lie outside the view.
+    bool beginInstance(const Instance& instance) {
+        Model& model = *this->models[instance.model];
+        if (!instance.isVisible || model.empty()) {
+            return false;
+        }
+        this->cullCounters.instances++;
+
+        this->frameMesh = &model;
+        this->frameMaterial = instance.material;
+        this->frameModel = this->sceneTransform * instance.transform;
+        this->isFrameRigid = instance.isRigid;
+
+        Mat3<float> linear = this->frameModel.linear();
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                linear.m[r][c] = std::abs(linear.m[r][c]);
+            }
+        }
+        Vec3<float> center = this->frameModel * ((model.boundsMin + model.boundsMax) * 0.5f);
+        Vec3<float> extent = linear * ((model.boundsMax - model.boundsMin) * 0.5f);
+        if (isBoxOutsideFrustum(center, extent)) {
+            unsigned int triangles = model.lengthOfTriangleArray / 3;
+            this->cullCounters.instancesCulled++;
+            this->cullCounters.triangles += triangles;
+            this->cullCounters.outsideFrustum += triangles;
+            return false;
+        }
+
+        transformVertices();
+        return true;
+    }
+
+    static double secondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Runs the vertex and normal streams of the instance through the SIMD kernels with its model
+    // matrix, instead of calling Vec3::rotate for every corner of every triangle.
+    void transformVertices() {
+        INSTRUMENT_SCOPE(this->statistics.times.transform);
+        const Mat4<float>& model = this->frameModel;
+        selectDetailLevel();
+
+        Mat3<float> normalMatrix = this->isFrameRigid ? model.linear() : model.normalMatrix();
+        this->kernels.transform(Mat4<float>(normalMatrix), *this->frameNormals, this->transformedNormalStream);
+        if (!this->isFrameRigid) {
+            for (unsigned int i = 0; i < this->frameTriangleLength / 3; i++) {
+                Vec3<float> n = this->transformedNormalStream.get(i);
+                n.normalize();
+                this->transformedNormalStream.set(i, n);
+            }
+        }
+        if (isSmooth()) {
+            this->kernels.transform(Mat4<float>(normalMatrix), *this->frameVertexNormals, this->transformedVertexNormalStream);
+            if (!this->isFrameRigid) {
+                for (size_t i = 0; i < this->frameVertexNormals->length(); i++) {
+                    Vec3<float> n = this->transformedVertexNormalStream.get(i);
+                    if (n.length() > 0) {
+                        n.normalize();
+                    }
+                    this->transformedVertexNormalStream.set(i, n);
+                }
+            }
+            this->kernels.dot(this->transformedVertexNormalStream, this->lightDirection, this->vertexLightArray);
+        } else {
+            this->kernels.dot(this->transformedNormalStream, this->lightDirection, this->faceLightArray);
+        }
+
+        if (this->rasterMode == RasterMode::ScreenSpace) {
+            this->kernels.project(projection() * model, *this->frameVertices, this->transformedVertexStream);
+        } else {
+            this->kernels.transform(model, *this->frameVertices, this->transformedVertexStream);
+        }
+    }
+
+    // Points the frame at the coarsest level whose error, scaled by the model's largest stretch and
+    // projected at the nearest depth of the mesh's bounding sphere, is within maxDetailError cells
+    void selectDetailLevel() {
+        this->detailLevel = 0;
+        if (!this->frameMesh->lods.empty()) {
+            const Mat4<float>& m = this->frameModel;
+            float scale = 0;
+            for (int c = 0; c < 3; c++) {
+                scale = std::max(scale, std::sqrt(m.m[0][c] * m.m[0][c] + m.m[1][c] * m.m[1][c] + m.m[2][c] * m.m[2][c]));
+            }
+
+            float depth = (m * this->frameMesh->lods.boundsCenter()).z + this->distanceFromCam - scale * this->frameMesh->lods.boundsRadius();
+            if (depth > NEAR_PLANE) {
+                float cellsPerUnit = scale * std::max(this->horizontalScale, this->verticalScale) / depth;
+                while (this->detailLevel + 1 < this->frameMesh->lods.size() && this->frameMesh->lods.error(this->detailLevel + 1) * cellsPerUnit <= this->maxDetailError) {
+                    this->detailLevel++;
+                }
+            }
+        }
+
+        if (this->detailLevel == 0) {
+            this->frameVertices = &this->frameMesh->vertexStream;
+            this->frameNormals = &this->frameMesh->normalStream;
+            this->frameVertexNormals = &this->frameMesh->vertexNormalStream;
+            this->frameTriangles = this->frameMesh->triangleArray;
+            this->frameTriangleLength = this->frameMesh->lengthOfTriangleArray;
+        } else {
+            const LodChain::Level& level = this->frameMesh->lods.level(this->detailLevel);
+            this->frameVertices = &level.vertices;
+            this->frameNormals = &level.normals;
+            this->frameVertexNormals = &level.vertexNormals;
+            this->frameTriangles = level.triangles.data();
+            this->frameTriangleLength = (unsigned int)level.triangles.size();
+        }
+    }
+
+    bool isSmooth() const {
+        return this->shadingMode == ShadingMode::Smooth;
+    }
+
+    // Light of each corner of a triangle: its vertex lights, or the face light three times
+    void cornerLights(int i0, int i1, int i2, int normalId, float* light) const {
+        if (isSmooth()) {
+            light[0] = this->vertexLightArray[i0];
+            light[1] = this->vertexLightArray[i1];
+            light[2] = this->vertexLightArray[i2];
+        } else {
+            light[0] = light[1] = light[2] = this->faceLightArray[normalId];
+        }
+    }
+
+    // False when no corner of a polygon is lit, so none of it would be drawn
+    static bool isLit(const float* light, int count) {
+        for (int k = 0; k < count; k++) {
+            if (light[k] > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Mat4<float> projection() const {
+        return Mat4<float>::screenProjection((float)(this->screenWidth / 2), (float)(this->screenHeight / 2),
+                                             this->horizontalScale, this->verticalScale, this->distanceFromCam);
+    }
+
+    // RasterMode::ObjectScan: culls and clips the view-space triangles, then scans the survivors
+    void renderTriangles() {
+        INSTRUMENT_SCOPE(this->statistics.times.rasterize);
+        if (!this->frameMesh->bvh.empty() && this->detailLevel == 0) {
+            traverseHierarchy();
+            return;
+        }
+
+        for (unsigned int i = 0; i < this->frameTriangleLength; i += 3) {
+            scanTriangle(this->frameTriangles[i], this->frameTriangles[i + 1], this->frameTriangles[i + 2], i / 3);
+        }
+    }
+
+    // Moves the coarse depth rejections of the frame into cullCounters
+    void countDepthRejections() {
+        this->cullCounters.depthRejected = this->coarseDepth.rejectedTriangles;
+        this->cullCounters.depthRejectedBlocks = this->coarseDepth.rejectedBlocks;
+        this->coarseDepth.resetCounters();
+
+        for (CoarseDepthBuffer& tile : this->tileCoarseDepth) {
+            this->cullCounters.depthRejected += tile.rejectedTriangles;
+            this->cullCounters.depthRejectedBlocks += tile.rejectedBlocks;
+            tile.resetCounters();
+        }
+    }
+
+#ifdef RENDERER_INSTRUMENTATION
+    // Copies the triangle counts of the frame from cullCounters into statistics
+    void countTriangles() {
+        const CullStats& counters = this->cullCounters;
+        this->statistics.trianglesSubmitted = counters.triangles;
+        this->statistics.trianglesCulled = counters.backFacing + counters.outsideFrustum + counters.unlit + counters.occluded;
+        this->statistics.trianglesRasterized = counters.drawn;
+    }
+
+    // Writes lastStatistics over the bottom row, in milliseconds, triangles, samples and bytes
+    void drawStatusLine() {
+        const FrameStats& stats = this->lastStatistics;
+        char line[256];
+        int length = std::snprintf(line, sizeof(line),
+                                   "%.1fms transform %.1f setup %.1f raster %.1f present %.1f sleep %.1f"
+                                   " | tris %llu/%llu/%llu | samples %llu/%llu/%llu | %lluB",
+                                   stats.times.total() * 1e3, stats.times.transform * 1e3, stats.times.setup * 1e3,
+                                   stats.times.rasterize * 1e3, stats.times.present * 1e3, stats.times.sleep * 1e3,
+                                   stats.trianglesSubmitted, stats.trianglesCulled, stats.trianglesRasterized,
+                                   stats.samples.tested, stats.samples.depthPassed, stats.samples.written, stats.bytesWritten);
+
+        char* row = this->outputBuffer + (this->screenHeight - 1) * this->screenWidth;
+        std::memset(row, this->background, this->screenWidth);
+        this->dirtyBounds.add(0, this->screenHeight - 1, this->screenWidth - 1, this->screenHeight - 1);
+        std::memcpy(row, line, std::min((unsigned int)std::max(length, 0), std::min(this->screenWidth, (unsigned int)sizeof(line) - 1)));
+    }
+#endif
+
+    void scanTriangle(int i0, int i1, int i2, int normalId) {
+        const SoAVertexBuffer& view = this->transformedVertexStream;
+        Vec3<float> v[3] = { view.get(i0), view.get(i1), view.get(i2) };
+        this->cullCounters.triangles++;
+
+        int inFront = 0;
+        for (int k = 0; k < 3; k++) {
+            inFront += v[k].z + this->distanceFromCam >= NEAR_PLANE;
+        }
+        if (inFront == 0) {
+            this->cullCounters.outsideFrustum++;
+            return;
+        }
+        if (isBackFacing(normalId, v[0])) {
+            this->cullCounters.backFacing++;
+            return;
+        }
+
+        float light[3], clippedLight[4];
+        cornerLights(i0, i1, i2, normalId, light);
+
+        Vec3<float> clipped[4];
+        int count = 3;
+        if (inFront < 3) {
+            this->cullCounters.nearClipped++;
+            count = clipNearPlane(v, clipped, light, clippedLight);
+        } else {
+            std::copy(v, v + 3, clipped);
+            std::copy(light, light + 3, clippedLight);
+        }
+
+        if (isOutsideFrustum(clipped, count)) {
+            this->cullCounters.outsideFrustum++;
+            return;
+        }
+        if (!isLit(clippedLight, count)) {
+            this->cullCounters.unlit++;
+            return;
+        }
+
+        this->cullCounters.drawn++;
+        for (int k = 1; k + 1 < count; k++) {
+            renderTriangle(clipped[0], clipped[k], clipped[k + 1], clippedLight[0], clippedLight[k], clippedLight[k + 1]);
+        }
+    }
+
+    // Depth-first walk of the BVH, nearer child first. Nodes are tested as view-space boxes: the
+    // model-space box transformed by frameModel and re-bounded.
+    void traverseHierarchy() {
+        const std::vector<BvhNode>& nodes = this->frameMesh->bvh.getNodes();
+        const std::vector<int>& order = this->frameMesh->bvh.order();
+        const std::vector<int>& triangles = this->frameMesh->bvh.triangles();
+
+        // Every node popped pushes its two children, so the stack never holds more than one node per level
+        uint32_t* stack = this->frameArena.allocate<uint32_t>(this->frameMesh->bvh.height() + 1);
+        size_t stackSize = 0;
+
+        Mat3<float> linear = this->frameModel.linear();
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                linear.m[r][c] = std::abs(linear.m[r][c]);
+            }
+        }
+
+        bool isImmediate = this->rasterMode == RasterMode::ObjectScan || !this->threadPool;
+        Mat4<float> projection = this->projection();
+
+        stack[stackSize++] = 0;
+        while (stackSize > 0) {
+            uint32_t index = stack[--stackSize];
+            const BvhNode& node = nodes[index];
+            this->cullCounters.nodesVisited++;
+
+            Vec3<float> center = this->frameModel * Vec3<float>((node.minX + node.maxX) / 2, (node.minY + node.maxY) / 2, (node.minZ + node.maxZ) / 2);
+            Vec3<float> extent = linear * Vec3<float>((node.maxX - node.minX) / 2, (node.maxY - node.minY) / 2, (node.maxZ - node.minZ) / 2);
+
+            if (isBoxOutsideFrustum(center, extent)) {
+                this->cullCounters.nodesCulled++;
+                this->cullCounters.triangles += this->frameMesh->bvh.triangleCount(index);
+                this->cullCounters.outsideFrustum += this->frameMesh->bvh.triangleCount(index);
+                continue;
+            }
+            if (isImmediate && isBoxOccluded(center, extent)) {
+                this->cullCounters.nodesOccluded++;
+                this->cullCounters.triangles += this->frameMesh->bvh.triangleCount(index);
+                this->cullCounters.occluded += this->frameMesh->bvh.triangleCount(index);
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                for (uint32_t t = node.leftFirst; t < node.leftFirst + node.count; t++) {
+                    if (this->rasterMode == RasterMode::ObjectScan) {
+                        scanTriangle(triangles[3 * t], triangles[3 * t + 1], triangles[3 * t + 2], order[t]);
+                    } else {
+                        setupTriangle(triangles[3 * t], triangles[3 * t + 1], triangles[3 * t + 2], order[t], projection);
+                    }
+                }
+                if (this->rasterMode == RasterMode::ScreenSpace && isImmediate) {
+                    rasterizeSetups();
+                }
+                continue;
+            }
+
+            // Pushed last, popped first: the child whose center is closer to the camera
+            const BvhNode& left = nodes[node.leftFirst];
+            const BvhNode& right = nodes[node.leftFirst + 1];
+            float leftDepth = viewDepth((left.minX + left.maxX) / 2, (left.minY + left.maxY) / 2, (left.minZ + left.maxZ) / 2);
+            float rightDepth = viewDepth((right.minX + right.maxX) / 2, (right.minY + right.maxY) / 2, (right.minZ + right.maxZ) / 2);
+            bool isLeftNearer = leftDepth <= rightDepth;
+            stack[stackSize++] = isLeftNearer ? node.leftFirst + 1 : node.leftFirst;
+            stack[stackSize++] = isLeftNearer ? node.leftFirst : node.leftFirst + 1;
+        }
+    }
+
+    // View-space z of a model-space point
+    float viewDepth(float x, float y, float z) const {
+        const Mat4<float>& m = this->frameModel;
+        return m.m[2][0] * x + m.m[2][1] * y + m.m[2][2] * z + m.m[2][3];
+    }
+
+    // The planes of isOutsideFrustum and the near plane, tested against a view-space box
+    bool isBoxOutsideFrustum(const Vec3<float>& center, const Vec3<float>& extent) const {
+        float centerX = (float)(this->screenWidth / 2), centerY = (float)(this->screenHeight / 2);
+        float depth = center.z + this->distanceFromCam;
+        float hs = this->horizontalScale, vs = this->verticalScale;
+
+        // Plane a * x + b * y + c * depth >= 0 with a box of half size extent: outside when even
+        // the corner furthest along the plane normal is behind it
+        auto isOutside = [&](float a, float b, float c) {
+            return a * center.x + b * center.y + c * depth + std::abs(a) * extent.x + std::abs(b) * extent.y + std::abs(c) * extent.z < 0;
+        };
+
+        return depth + extent.z < NEAR_PLANE
+            || isOutside(hs, 0, 2 + centerX)
+            || isOutside(-hs, 0, this->screenWidth + 1 - centerX)
+            || isOutside(0, -vs, 2 + centerY)
+            || isOutside(0, vs, this->screenHeight + 1 - centerY);
+    }
+
+    // True when every cell the box can reach already holds something nearer than the box's nearest point
+    bool isBoxOccluded(const Vec3<float>& center, const Vec3<float>& extent) {
+        float nearDepth = center.z - extent.z + this->distanceFromCam;
+        float farDepth = center.z + extent.z + this->distanceFromCam;
+        if (!(nearDepth >= NEAR_PLANE) || !std::isfinite(farDepth)) {
+            return false;
+        }
+
+        float centerX = (float)(this->screenWidth / 2), centerY = (float)(this->screenHeight / 2);
+        float minX = INFINITY, maxX = -INFINITY, minY = INFINITY, maxY = -INFINITY;
+        for (float depth : { nearDepth, farDepth }) {
+            for (float sign : { -1.0f, 1.0f }) {
+                float x = centerX + this->horizontalScale * (center.x + sign * extent.x) / depth;
+                float y = centerY - this->verticalScale * (center.y + sign * extent.y) / depth;
+                minX = std::min(minX, x);
+                maxX = std::max(maxX, x);
+                minY = std::min(minY, y);
+                maxY = std::max(maxY, y);
+            }
+        }
+
+        // One cell of slack on every side covers both the truncation of ObjectScan and cell centers
+        float width = (float)this->screenWidth, height = (float)this->screenHeight;
+        int x0 = (int)std::floor(std::max(-1.0f, std::min(width, minX))) - 1, x1 = (int)std::floor(std::max(-1.0f, std::min(width, maxX))) + 1;
+        int y0 = (int)std::floor(std::max(-1.0f, std::min(height, minY))) - 1, y1 = (int)std::floor(std::max(-1.0f, std::min(height, maxY))) + 1;
+
+        return this->coarseDepth.isOccluded(x0, x1, y0, y1, 1 / nearDepth);
+    }
+
+    // True when no sample renderTriangle would take inside the view-space rectangle
+    // [minX, maxX] x [minY, maxY] of the triangle's plane can pass the depth test
+    bool isScanOccluded(Triangle<float>& triangle, float minX, float maxX, float minY, float maxY) {
+        float minZ = INFINITY, maxZ = -INFINITY;
+        for (float x : { minX, maxX }) {
+            for (float y : { minY, maxY }) {
+                float z = triangle.getZFrom(x, y);
+                minZ = std::min(minZ, z);
+                maxZ = std::max(maxZ, z);
+            }
+        }
+
+        // The plane is linear, so its corners bound it; the slack covers rounding at inner samples
+        const Vec3<float>& n = triangle.normal;
+        float terms = std::abs(triangle.D) + std::abs(n.x) * std::max(std::abs(minX), std::abs(maxX))
+                    + std::abs(n.y) * std::max(std::abs(minY), std::abs(maxY));
+        float slack = 4 * FLT_EPSILON * (std::abs(minZ) + std::abs(maxZ) + this->distanceFromCam);
+        if (n.z != 0) {
+            slack += 4 * FLT_EPSILON * terms / std::abs(n.z);
+        }
+
+        Vec3<float> center((minX + maxX) / 2, (minY + maxY) / 2, (minZ + maxZ) / 2);
+        Vec3<float> extent((maxX - minX) / 2, (maxY - minY) / 2, (maxZ - minZ) / 2 + slack);
+        return isBoxOccluded(center, extent);
+    }
+
+    // Position relative to the camera of a view-space point
+    Vec3<float> fromCamera(const Vec3<float>& viewPosition) const {
+        return Vec3<float>(viewPosition.x, viewPosition.y, viewPosition.z + this->distanceFromCam);
+    }
+
+    // Any point of the triangle's plane gives the same answer, including points behind the camera
+    bool isBackFacing(int normalId, const Vec3<float>& viewPosition) const {
+        return this->isBackFaceCulling && this->transformedNormalStream.get(normalId) * fromCamera(viewPosition) > 0;
+    }
+
+    // Sutherland-Hodgman against depth >= NEAR_PLANE. Writes 0, 3 or 4 view-space vertices to out,
+    // keeping the winding of the input triangle, and returns how many. The corner lights in inLight,
+    // if given, are interpolated to outLight along with the vertices.
+    int clipNearPlane(const Vec3<float>* in, Vec3<float>* out, const float* inLight = nullptr, float* outLight = nullptr) const {
+        int count = 0;
+        for (int k = 0; k < 3; k++) {
+            const Vec3<float>& a = in[k];
+            const Vec3<float>& b = in[(k + 1) % 3];
+            float distanceA = a.z + this->distanceFromCam - NEAR_PLANE;
+            float distanceB = b.z + this->distanceFromCam - NEAR_PLANE;
+
+            if (distanceA >= 0) {
+                if (inLight != nullptr) {
+                    outLight[count] = inLight[k];
+                }
+                out[count++] = a;
+            }
+            if ((distanceA >= 0) != (distanceB >= 0)) {
+                float t = distanceA / (distanceA - distanceB);
+                if (inLight != nullptr) {
+                    outLight[count] = inLight[k] + (inLight[(k + 1) % 3] - inLight[k]) * t;
+                }
+                out[count++] = a + (b - a) * t;
+            }
+        }
+        return count;
+    }
+
+    // True when every view-space vertex, all in front of the near plane, projects beyond the same
+    // screen edge. One cell of slack covers the truncation in projectVertex.
+    bool isOutsideFrustum(const Vec3<float>* v, int count) const {
+        float centerX = (float)(this->screenWidth / 2), centerY = (float)(this->screenHeight / 2);
+        int left = 0, right = 0, top = 0, bottom = 0;
+
+        for (int k = 0; k < count; k++) {
+            float depth = v[k].z + this->distanceFromCam;
+            float x = this->horizontalScale * v[k].x;
+            float y = -this->verticalScale * v[k].y;
+
+            left += x < (-2 - centerX) * depth;
+            right += x >= (this->screenWidth + 1 - centerX) * depth;
+            top += y < (-2 - centerY) * depth;
+            bottom += y >= (this->screenHeight + 1 - centerY) * depth;
+        }
+        return left == count || right == count || top == count || bottom == count;
+    }
+
+    // Same test after projection, on screen x, screen y and 1/z
+    bool isOutsideScreen(const Vec3<float>* p, int count) const {
+        int left = 0, right = 0, top = 0, bottom = 0;
+
+        for (int k = 0; k < count; k++) {
+            left += p[k].x < 0;
+            right += p[k].x > this->screenWidth;
+            top += p[k].y < 0;
+            bottom += p[k].y > this->screenHeight;
+        }
+        return left == count || right == count || top == count || bottom == count;
+    }
+
+    // l0, l1 and l2 are the lights of the corners. When they differ, light is interpolated over the
+    // triangle as a plane in view x and y, and stepped down each column of samples.
+    void renderTriangle(Vec3<float>& v0, Vec3<float>& v1, Vec3<float>& v2, float l0, float l1, float l2) {
+        Triangle<float> triangle(v0, v1, v2);
+
+        float minX = std::min(v0.x, std::min(v1.x, v2.x));
+        float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+
+        float minY = std::min(v0.y, std::min(v1.y, v2.y));
+        float maxY = std::max(v0.y, std::max(v1.y, v2.y));
+
+        float samples = ((maxX - minX) / this->scanStep + 1) * ((maxY - minY) / this->scanStep + 1);
+        if (this->isEarlyDepthTest && samples >= OCCLUSION_TEST_SAMPLES && isScanOccluded(triangle, minX, maxX, minY, maxY)) {
+            this->coarseDepth.rejectedTriangles++;
+            return;
+        }
+
+        float lightDx = 0, lightDy = 0;
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if ((l0 != l1 || l1 != l2) && area != 0) {
+            lightDx = ((l1 - l0) * (v2.y - v0.y) - (l2 - l0) * (v1.y - v0.y)) / area;
+            lightDy = ((l2 - l0) * (v1.x - v0.x) - (l1 - l0) * (v2.x - v0.x)) / area;
+        }
+        float lightStep = lightDy * this->scanStep;
+
+        for (float x = minX; x < maxX; x += scanStep) {
+            float L = l0 + lightDx * (x - v0.x) + lightDy * (minY - v0.y);
+            for (float y = minY; y < maxY; y += scanStep, L += lightStep) {
+                Vec3<float> vertex(x, y, triangle.getZFrom(x, y));
+
+                if (triangle.containsVertex(vertex)) {
+                    projectVertex(vertex, L);
+                }
+            }
+        }
+    }
+
+    void projectVertex(const Vec3<float>& vertex, float L) {
+        float ooz = 1 / (vertex.z + this->distanceFromCam);
+        int xp = (int)((this->screenWidth / 2) + (this->horizontalScale * vertex.x * ooz));
+        int yp = (int)((this->screenHeight / 2) - (this->verticalScale * vertex.y * ooz));
+
+        // Samples of triangles straddling the screen edge must not touch depth of a wrapped-around cell.
+        // Negative coordinates wrap to large unsigned ones, so one test per axis covers both edges.
+        if ((unsigned int)xp >= this->screenWidth || (unsigned int)yp >= this->screenHeight) {
+            return;
+        }
+        int index = xp + yp * this->screenWidth;
+
+        INSTRUMENT(this->statistics.samples.tested++; this->statistics.samples.depthPassed += ooz > this->zBuffer[index];)
+        if (ooz > this->zBuffer[index] && L > 0) {
+            INSTRUMENT(this->statistics.samples.written++;)
+            this->zBuffer[index] = ooz;
+            this->coarseDepth.written(this->coarseDepth.blockOf(xp, yp), ooz);
+            this->outputBuffer[index] = shade(L);
+            if (this->materialPlane != nullptr) {
+                this->materialPlane[index] = this->frameMaterial;
+            }
+            this->dirtyBounds.add(xp, yp, xp, yp);
+        }
+    }
+
+    char shade(float L) const {
+        int lightLevel = std::min((float)this->gradientSize - 1, L * this->lightIntensity);
+        return this->gradient[lightLevel];
+    }
+
+    // Edges on the top or left of the triangle own the cells lying exactly on them, 
+    // so cells on an edge shared by two triangles are filled by only one of them.
+    static bool isTopLeftEdge(int64_t ax, int64_t ay, int64_t bx, int64_t by) {
+        return (by - ay < 0) || (by == ay && bx - ax > 0);
+    }
+
+    // Edge a -> b as a * px + b * py + c, biased so that a plain >= 0 test applies the top-left rule
+    static void setupEdge(int64_t ax, int64_t ay, int64_t bx, int64_t by, int64_t& a, int64_t& b, int64_t& c) {
+        a = ay - by;
+        b = bx - ax;
+        c = by * ax - bx * ay;
+        if (!isTopLeftEdge(ax, ay, bx, by)) {
+            c -= 1;
+        }
+    }
+
+    // RasterMode::ScreenSpace: culls the projected triangles of the instance and appends setups for the survivors
+    void setupTriangles() {
+        if (!this->frameMesh->bvh.empty() && this->detailLevel == 0) {
+            traverseHierarchy();
+            return;
+        }
+
+        Mat4<float> projection = this->projection();
+        for (unsigned int i = 0; i < this->frameTriangleLength; i += 3) {
+            setupTriangle(this->frameTriangles[i], this->frameTriangles[i + 1], this->frameTriangles[i + 2], i / 3, projection);
+        }
+    }
+
+    // Appends the setups of one triangle, two when clipping against the near plane leaves a
+    // quadrilateral. Such triangles are clipped in view space and projected again.
+    void setupTriangle(int i0, int i1, int i2, int normalId, const Mat4<float>& projection) {
+        const SoAVertexBuffer& projected = this->transformedVertexStream;
+        int index[3] = { i0, i1, i2 };
+        Vec3<float> p[4] = { projected.get(i0), projected.get(i1), projected.get(i2) };
+        this->cullCounters.triangles++;
+
+        // Points behind the camera were projected to 1/z = 0
+        float maxOoz = 1 / NEAR_PLANE;
+        int inFront = 0;
+        for (int k = 0; k < 3; k++) {
+            inFront += p[k].z > 0 && p[k].z <= maxOoz;
+        }
+        if (inFront == 0) {
+            this->cullCounters.outsideFrustum++;
+            return;
+        }
+        if (this->isBackFaceCulling && isBackFacing(normalId, this->frameModel * this->frameVertices->get(i0))) {
+            this->cullCounters.backFacing++;
+            return;
+        }
+
+        float light[4];
+        cornerLights(i0, i1, i2, normalId, light);
+
+        int count = 3;
+        if (inFront < 3) {
+            this->cullCounters.nearClipped++;
+
+            Vec3<float> view[3], clipped[4];
+            float cornerLight[3] = { light[0], light[1], light[2] };
+            for (int k = 0; k < 3; k++) {
+                view[k] = this->frameModel * this->frameVertices->get(index[k]);
+            }
+            count = clipNearPlane(view, clipped, cornerLight, light);
+            projection.projectPoints(clipped, p, count);
+        }
+
+        if (isOutsideScreen(p, count)) {
+            this->cullCounters.outsideFrustum++;
+            return;
+        }
+        if (!isLit(light, count)) {
+            this->cullCounters.unlit++;
+            return;
+        }
+
+        this->cullCounters.drawn++;
+        TriangleSetup setup;
+        for (int k = 1; k + 1 < count; k++) {
+            if (setupTriangle(p[0], p[k], p[k + 1], light[0], light[k], light[k + 1], setup)) {
+                this->setupArray.push_back(setup);
+                this->dirtyBounds.add(setup.minX, setup.minY, setup.maxX, setup.maxY);
+            }
+        }
+    }
+
+    // p0, p1 and p2 are projected vertices: screen x, screen y and 1/z, all in front of the near plane,
+    // and l0, l1 and l2 their lights. Returns false when the triangle covers no cell.
+    bool setupTriangle(const Vec3<float>& p0, const Vec3<float>& p1, const Vec3<float>& p2,
+                       float l0, float l1, float l2, TriangleSetup& setup) const {
+        float ooz0 = p0.z, ooz1 = p1.z, ooz2 = p2.z;
+        float x0 = p0.x, y0 = p0.y;
+        float x1 = p1.x, y1 = p1.y;
+        float x2 = p2.x, y2 = p2.y;
+
+        float minXf = std::min(x0, std::min(x1, x2)), maxXf = std::max(x0, std::max(x1, x2));
+        float minYf = std::min(y0, std::min(y1, y2)), maxYf = std::max(y0, std::max(y1, y2));
+        if (minXf < -GUARD_BAND || maxXf > GUARD_BAND || minYf < -GUARD_BAND || maxYf > GUARD_BAND) {
+            return false;
+        }
+
+        // Cell (x, y) covers [x, x + 1) x [y, y + 1) and is sampled at its center
+        setup.minX = std::max(0, (int)std::ceil(minXf - 0.5f));
+        setup.maxX = std::min((int)this->screenWidth - 1, (int)std::floor(maxXf - 0.5f));
+        setup.minY = std::max(0, (int)std::ceil(minYf - 0.5f));
+        setup.maxY = std::min((int)this->screenHeight - 1, (int)std::floor(maxYf - 0.5f));
+        if (setup.minX > setup.maxX || setup.minY > setup.maxY) {
+            return false;
+        }
+
+        float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (area == 0) {
+            return false;
+        }
+        setup.x0 = x0;
+        setup.y0 = y0;
+        setup.ooz = ooz0;
+        setup.oozDx = ((ooz1 - ooz0) * (y2 - y0) - (ooz2 - ooz0) * (y1 - y0)) / area;
+        setup.oozDy = ((ooz2 - ooz0) * (x1 - x0) - (ooz1 - ooz0) * (x2 - x0)) / area;
+
+        // Cells are evaluated within one bounding box of vertex 0, so the terms stay below these
+        float rounding = 4 * FLT_EPSILON * (std::abs(ooz0) + std::abs(setup.oozDx) * (maxXf - minXf + 1) + std::abs(setup.oozDy) * (maxYf - minYf + 1));
+        setup.minOoz = std::min(ooz0, std::min(ooz1, ooz2)) - rounding;
+        setup.maxOoz = std::max(ooz0, std::max(ooz1, ooz2)) + rounding;
+
+        int64_t fx0 = std::llround(x0 * SUBPIXEL_ONE), fy0 = std::llround(y0 * SUBPIXEL_ONE);
+        int64_t fx1 = std::llround(x1 * SUBPIXEL_ONE), fy1 = std::llround(y1 * SUBPIXEL_ONE);
+        int64_t fx2 = std::llround(x2 * SUBPIXEL_ONE), fy2 = std::llround(y2 * SUBPIXEL_ONE);
+
+        int64_t fixedArea = (fx1 - fx0) * (fy2 - fy0) - (fy1 - fy0) * (fx2 - fx0);
+        if (fixedArea == 0) {
+            return false;
+        }
+        if (fixedArea < 0) {
+            std::swap(fx1, fx2);
+            std::swap(fy1, fy2);
+        }
+
+        // Edge functions w0, w1, w2 are opposite to vertices 0, 1, 2
+        setupEdge(fx1, fy1, fx2, fy2, setup.a0, setup.b0, setup.c0);
+        setupEdge(fx2, fy2, fx0, fy0, setup.a1, setup.b1, setup.c1);
+        setupEdge(fx0, fy0, fx1, fy1, setup.a2, setup.b2, setup.c2);
+
+        setup.isSmooth = isSmooth();
+        setup.material = this->frameMaterial;
+        if (!setup.isSmooth) {
+            setup.color = shade(l0);
+            return true;
+        }
+
+        // Like 1/z, light is a plane over screen x and y, here in gradient levels
+        float level0 = l0 * this->lightIntensity, level1 = l1 * this->lightIntensity, level2 = l2 * this->lightIntensity;
+        setup.color = 0;
+        setup.level = level0;
+        setup.levelDx = ((level1 - level0) * (y2 - y0) - (level2 - level0) * (y1 - y0)) / area;
+        setup.levelDy = ((level2 - level0) * (x1 - x0) - (level1 - level0) * (x2 - x0)) / area;
+        return true;
+    }
+
+    // Rasterizes, on the calling thread, the setups appended since the last call
+    void rasterizeSetups() {
+        INSTRUMENT_SCOPE(this->statistics.times.rasterize);
+        for (; this->rasterizedSetups < this->setupArray.size(); this->rasterizedSetups++) {
+            const TriangleSetup& setup = this->setupArray[this->rasterizedSetups];
+            rasterizeTriangle(setup, setup.minX, setup.maxX, setup.minY, setup.maxY,
+                              this->outputBuffer, this->zBuffer, this->materialPlane, 0, 0, this->screenWidth, this->coarseDepth
+                              INSTRUMENT_ARG(this->statistics.samples));
+        }
+    }
+
+    // Fills the cells of the setup inside [minX, maxX] x [minY, maxY]. Cell (x, y) lives at
+    // (x - originX) + (y - originY) * stride of the given buffers, which lets tiles use private buffers.
+    // materialBuffer is nullptr without colorOutput().
+    // coarseDepth covers depthBuffer. Triangles it proves hidden are rejected before any cell is
+    // visited, and when only some of their blocks are hidden, the rest are filled block by block.
+    // Cells are counted into samples with RENDERER_INSTRUMENTATION.
+    void rasterizeTriangle(const TriangleSetup& setup, int minX, int maxX, int minY, int maxY,
+                           char* colorBuffer, float* depthBuffer, unsigned char* materialBuffer, int originX, int originY, int stride,
+                           CoarseDepthBuffer& coarseDepth INSTRUMENT_ARG(SampleCounters& samples)) const {
+        if (!this->isEarlyDepthTest) {
+            fillRect(setup, false, minX, maxX, minY, maxY, colorBuffer, depthBuffer, materialBuffer, originX, originY, stride INSTRUMENT_ARG(samples));
+            return;
+        }
+
+        int firstBlockX = minX - (minX - originX) % COARSE_BLOCK_WIDTH;
+        int firstBlockY = minY - (minY - originY) % COARSE_BLOCK_HEIGHT;
+
+        unsigned int blocks = 0, hiddenBlocks = 0;
+        bool isBehind = true;
+        for (int blockY = firstBlockY; blockY <= maxY; blockY += COARSE_BLOCK_HEIGHT) {
+            for (int blockX = firstBlockX; blockX <= maxX; blockX += COARSE_BLOCK_WIDTH) {
+                int block = coarseDepth.blockOf(blockX, blockY);
+                blocks++;
+                hiddenBlocks += coarseDepth.isBlockOccluded(block, setup.maxOoz);
+                isBehind = isBehind && coarseDepth.isBlockBehind(block, setup.minOoz);
+            }
+        }
+
+        if (hiddenBlocks == blocks) {
+            coarseDepth.rejectedTriangles++;
+            return;
+        }
+
+        // Splitting rows at block edges costs more than it saves when nothing can be skipped
+        if (hiddenBlocks == 0) {
+            unsigned int cells = fillRect(setup, isBehind, minX, maxX, minY, maxY, colorBuffer, depthBuffer, materialBuffer, originX, originY, stride INSTRUMENT_ARG(samples));
+            if (cells > 0) {
+                for (int blockY = firstBlockY; blockY <= maxY; blockY += COARSE_BLOCK_HEIGHT) {
+                    for (int blockX = firstBlockX; blockX <= maxX; blockX += COARSE_BLOCK_WIDTH) {
+                        coarseDepth.written(coarseDepth.blockOf(blockX, blockY), setup.maxOoz, cells);
+                    }
+                }
+            }
+            return;
+        }
+
+        coarseDepth.rejectedBlocks += hiddenBlocks;
+        for (int blockY = firstBlockY; blockY <= maxY; blockY += COARSE_BLOCK_HEIGHT) {
+            for (int blockX = firstBlockX; blockX <= maxX; blockX += COARSE_BLOCK_WIDTH) {
+                int block = coarseDepth.blockOf(blockX, blockY);
+                if (coarseDepth.isBlockOccluded(block, setup.maxOoz)) {
+                    continue;
+                }
+
+                int x0 = std::max(minX, blockX), x1 = std::min(maxX, blockX + COARSE_BLOCK_WIDTH - 1);
+                int y0 = std::max(minY, blockY), y1 = std::min(maxY, blockY + COARSE_BLOCK_HEIGHT - 1);
+                unsigned int cells = fillRect(setup, coarseDepth.isBlockBehind(block, setup.minOoz),
+                                              x0, x1, y0, y1, colorBuffer, depthBuffer, materialBuffer, originX, originY, stride INSTRUMENT_ARG(samples));
+                if (cells > 0) {
+                    coarseDepth.written(block, setup.maxOoz, cells);
+                }
+            }
+        }
+    }
+
+    // rasterizeRect instantiated for the setup's shading
+    unsigned int fillRect(const TriangleSetup& setup, bool isBehind, int minX, int maxX, int minY, int maxY,
+                          char* colorBuffer, float* depthBuffer, unsigned char* materialBuffer, int originX, int originY, int stride
+                          INSTRUMENT_ARG(SampleCounters& samples)) const {
+        if (setup.isSmooth) {
+            return isBehind ? rasterizeRect<true, true>(setup, minX, maxX, minY, maxY, colorBuffer, depthBuffer, materialBuffer, originX, originY, stride INSTRUMENT_ARG(samples))
+                            : rasterizeRect<false, true>(setup, minX, maxX, minY, maxY, colorBuffer, depthBuffer, materialBuffer, originX, originY, stride INSTRUMENT_ARG(samples));
+        }
+        return isBehind ? rasterizeRect<true, false>(setup, minX, maxX, minY, maxY, colorBuffer, depthBuffer, materialBuffer, originX, originY, stride INSTRUMENT_ARG(samples))
+                        : rasterizeRect<false, false>(setup, minX, maxX, minY, maxY, colorBuffer, depthBuffer, materialBuffer, originX, originY, stride INSTRUMENT_ARG(samples));
+    }
+
+    // The cells of rasterizeTriangle, without coarse tests. With isBehind every cell is known to be
+    // farther than the triangle, so depth is written without being compared. With isSmooth each cell
+    // takes its character from the light plane, and unlit cells are skipped. Returns how many cells were written.
+    template <bool isBehind, bool isSmooth>
+    unsigned int rasterizeRect(const TriangleSetup& setup, int minX, int maxX, int minY, int maxY,
+                               char* colorBuffer, float* depthBuffer, unsigned char* materialBuffer, int originX, int originY, int stride
+                               INSTRUMENT_ARG(SampleCounters& samples)) const {
+        unsigned int cells = 0;
+        INSTRUMENT(unsigned int tested = 0; unsigned int passed = 0;)
+        int64_t px = (int64_t)minX * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+        int64_t stepX0 = setup.a0 * SUBPIXEL_ONE, stepX1 = setup.a1 * SUBPIXEL_ONE, stepX2 = setup.a2 * SUBPIXEL_ONE;
+
+        for (int y = minY; y <= maxY; y++) {
+            int64_t py = (int64_t)y * SUBPIXEL_ONE + SUBPIXEL_ONE / 2;
+            int64_t w0 = setup.a0 * px + setup.b0 * py + setup.c0;
+            int64_t w1 = setup.a1 * px + setup.b1 * py + setup.c1;
+            int64_t w2 = setup.a2 * px + setup.b2 * py + setup.c2;
+
+            float rowOoz = setup.ooz + setup.oozDy * ((y + 0.5f) - setup.y0);
+            float rowLevel = isSmooth ? setup.level + setup.levelDy * ((y + 0.5f) - setup.y0) : 0;
+            int index = (minX - originX) + (y - originY) * stride;
+
+            for (int x = minX; x <= maxX; x++, index++) {
+                if ((w0 | w1 | w2) >= 0) {
+                    INSTRUMENT(tested++;)
+                    float ooz = rowOoz + setup.oozDx * ((x + 0.5f) - setup.x0);
+                    if (isSmooth) {
+                        if (isBehind || ooz > depthBuffer[index]) {
+                            INSTRUMENT(passed++;)
+                            float level = rowLevel + setup.levelDx * ((x + 0.5f) - setup.x0);
+                            if (level > 0) {
+                                depthBuffer[index] = ooz;
+                                colorBuffer[index] = this->gradient[(int)std::min(level, (float)(this->gradientSize - 1))];
+                                if (materialBuffer != nullptr) {
+                                    materialBuffer[index] = setup.material;
+                                }
+                                cells++;
+                            }
+                        }
+                    } else if (isBehind || ooz > depthBuffer[index]) {
+                        depthBuffer[index] = ooz;
+                        colorBuffer[index] = setup.color;
+                        if (materialBuffer != nullptr) {
+                            materialBuffer[index] = setup.material;
+                        }
+                        cells++;
+                    }
+                }
+                w0 += stepX0;
+                w1 += stepX1;
+                w2 += stepX2;
+            }
+        }
+        INSTRUMENT(samples.tested += tested; samples.depthPassed += isSmooth ? passed : cells; samples.written += cells;)
+        return cells;
+    }
+
+    // Bins the setups by tile, then rasterizes the tiles in parallel. Each tile is copied into the
+    // worker's private buffers, filled in submission order and copied back, so no locking is needed.
+    void rasterizeTiles() {
+        INSTRUMENT_SCOPE(this->statistics.times.rasterize);
+        binSetups();
+
+        this->threadPool->run(this->tilesX * this->tilesY, [this](size_t tile, unsigned int worker) {
+            int first = this->tileBinStart[tile];
+            int last = this->tileBinStart[tile + 1];
+            if (first == last) {
+                return;
+            }
+
+            int originX = (int)(tile % this->tilesX) * TILE_WIDTH;
+            int originY = (int)(tile / this->tilesX) * TILE_HEIGHT;
+            int width = std::min(TILE_WIDTH, (int)this->screenWidth - originX);
+            int height = std::min(TILE_HEIGHT, (int)this->screenHeight - originY);
+
+            char* colorBuffer = &this->tileOutputBuffer[worker * TILE_AREA];
+            float* depthBuffer = &this->tileZBuffer[worker * TILE_AREA];
+            unsigned char* materialBuffer = this->materialPlane != nullptr ? &this->tileMaterialBuffer[worker * TILE_AREA] : nullptr;
+            CoarseDepthBuffer& coarseDepth = this->tileCoarseDepth[worker];
+
+            for (int y = 0; y < height; y++) {
+                int index = originX + (originY + y) * this->screenWidth;
+                std::memcpy(colorBuffer + y * TILE_WIDTH, this->outputBuffer + index, width * sizeof(char));
+                std::memcpy(depthBuffer + y * TILE_WIDTH, this->zBuffer + index, width * sizeof(float));
+                if (materialBuffer != nullptr) {
+                    std::memcpy(materialBuffer + y * TILE_WIDTH, this->materialPlane + index, width);
+                }
+            }
+            if (this->isEarlyDepthTest) {
+                coarseDepth.attach(depthBuffer, originX, originY, width, height, TILE_WIDTH);
+            }
+
+            for (int bin = first; bin < last; bin++) {
+                const TriangleSetup& setup = this->setupArray[this->tileBinSetups[bin]];
+                rasterizeTriangle(setup,
+                                  std::max(setup.minX, originX), std::min(setup.maxX, originX + width - 1),
+                                  std::max(setup.minY, originY), std::min(setup.maxY, originY + height - 1),
+                                  colorBuffer, depthBuffer, materialBuffer, originX, originY, TILE_WIDTH, coarseDepth
+                                  INSTRUMENT_ARG(this->tileSamples[worker]));
+            }
+
+            for (int y = 0; y < height; y++) {
+                int index = originX + (originY + y) * this->screenWidth;
+                std::memcpy(this->outputBuffer + index, colorBuffer + y * TILE_WIDTH, width * sizeof(char));
+                std::memcpy(this->zBuffer + index, depthBuffer + y * TILE_WIDTH, width * sizeof(float));
+                if (materialBuffer != nullptr) {
+                    std::memcpy(this->materialPlane + index, materialBuffer + y * TILE_WIDTH, width);
+                }
+            }
+            this->coarseDepth.invalidate(originX, originY, width, height);
+        });
+
+        INSTRUMENT(
+            for (SampleCounters& samples : this->tileSamples) {
+                this->statistics.samples += samples;
+                samples = SampleCounters();
+            }
+        )
+    }
+
+    // Lists the setups overlapping each tile in the frame arena, in submission order: one pass counts
+    // them per tile, the next writes them at their tile's offset
+    void binSetups() {
+        unsigned int tiles = this->tilesX * this->tilesY;
+        this->tileBinStart = this->frameArena.allocate<int>(tiles + 1);
+        int* cursor = this->frameArena.allocate<int>(tiles);
+        std::fill(cursor, cursor + tiles, 0);
+
+        for (size_t i = 0; i < this->setupArray.size(); i++) {
+            const TriangleSetup& setup = this->setupArray[i];
+            for (int ty = setup.minY / TILE_HEIGHT; ty <= setup.maxY / TILE_HEIGHT; ty++) {
+                for (int tx = setup.minX / TILE_WIDTH; tx <= setup.maxX / TILE_WIDTH; tx++) {
+                    cursor[tx + ty * this->tilesX]++;
+                }
+            }
+        }
+
+        int total = 0;
+        for (unsigned int tile = 0; tile < tiles; tile++) {
+            this->tileBinStart[tile] = total;
+            total += cursor[tile];
+            cursor[tile] = this->tileBinStart[tile];
+        }
+        this->tileBinStart[tiles] = total;
+
+        this->tileBinSetups = this->frameArena.allocate<int>(total);
+        for (size_t i = 0; i < this->setupArray.size(); i++) {
+            const TriangleSetup& setup = this->setupArray[i];
+            for (int ty = setup.minY / TILE_HEIGHT; ty <= setup.maxY / TILE_HEIGHT; ty++) {
+                for (int tx = setup.minX / TILE_WIDTH; tx <= setup.maxX / TILE_WIDTH; tx++) {
+                    this->tileBinSetups[cursor[tx + ty * this->tilesX]++] = (int)i;
+                }
+            }
         }
     }
 };
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "binarymesh.hpp"
+#include "bvh.hpp"
+#include "geometry.hpp"
+#include "lod.hpp"
+#include "mesh.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+// Unit normal of every vertex: the face normals of the triangles around it, weighted by their
+// areas, so small slivers barely bend it. Vertices no triangle uses get a zero normal.
+inline void computeVertexNormals(const SoAVertexBuffer& vertices, const int* triangles, size_t triangleCount,
+                                 const SoAVertexBuffer& faceNormals, SoAVertexBuffer& vertexNormals) {
+    std::vector<Vec3<float>> sums(vertices.length(), Vec3<float>(0, 0, 0));
+    for (size_t t = 0; t < triangleCount; t++) {
+        const int* corners = &triangles[3 * t];
+        Vec3<float> v0 = vertices.get(corners[0]);
+        Vec3<float> v1 = vertices.get(corners[1]);
+        Vec3<float> v2 = vertices.get(corners[2]);
+
+        // Twice the area; only the ratio between faces matters
+        Vec3<float> weighted = faceNormals.get(t) * ((v1 - v0) ^ (v2 - v0)).length();
+        for (int k = 0; k < 3; k++) {
+            sums[corners[k]] += weighted;
+        }
+    }
+
+    vertexNormals.resize(vertices.length());
+    for (size_t i = 0; i < vertexNormals.padded(); i++) {
+        Vec3<float> n = i < sums.size() ? sums[i] : Vec3<float>(0, 0, 0);
+        if (n.length() > 0) {
+            n.normalize();
+        }
+        vertexNormals.set(i, n);
+    }
+}
+
+// One mesh and everything derived from it: streams, face and vertex normals, bounds, hierarchy and
+// levels of detail. Derived data is built once by prepare() and shared by every instance drawn with it.
+struct Model {
+    unsigned int lengthOfVertexArray = 0;
+
+    unsigned int lengthOfTriangleArray = 0;
+    const int* triangleArray = nullptr;
+
+    unsigned int lengthOfNormalArray = 0;
+    Vec3<float>* normalArray = nullptr;
+
+    // Storage behind the arrays above, when they are not borrowed
+    std::vector<int> ownedTriangles;
+    std::vector<Vec3<float>> ownedNormals;
+
+    // Face normals that were given are kept; otherwise they are derived by prepare()
+    bool hasUserNormals = false;
+
+    // The normal stream below borrows caller memory and is not reloaded
+    bool hasNormalView = false;
+
+    // Vertices, copied in when they are set or borrowed from caller memory, and a structure-of-arrays
+    // copy of normalArray
+    SoAVertexBuffer vertexStream;
+    SoAVertexBuffer normalStream;
+
+    // Area-weighted vertex normals, derived by prepare() for smooth shading
+    SoAVertexBuffer vertexNormalStream;
+
+    // Model-space bounding box
+    Vec3<float> boundsMin;
+    Vec3<float> boundsMax;
+
+    Bvh bvh;
+    LodChain lods;
+
+    // Cleared whenever the arrays or the derived data that is wanted change
+    bool isPrepared = false;
+
+    bool empty() const {
+        return this->vertexStream.length() == 0 || this->triangleArray == nullptr;
+    }
+
+    // Converts the vertices of a loaded mesh straight into the vertex stream, freeing them with the
+    // mesh, and takes over its triangles without copying them
+    void load(Mesh&& mesh) {
+        if (mesh.vertices.empty() || mesh.triangles.empty() || mesh.triangles.size() % 3 != 0) {
+            throw std::invalid_argument("Renderer Mesh Error: Invalid mesh!");
+        }
+        for (int index : mesh.triangles) {
+            if (index < 0 || index >= (int)mesh.vertices.size()) {
+                throw std::invalid_argument("Renderer Mesh Error: Triangle index out of range!");
+            }
+        }
+
+        this->vertexStream.load(mesh.vertices.data(), mesh.vertices.size());
+        this->lengthOfVertexArray = (unsigned int)mesh.vertices.size();
+
+        this->ownedTriangles = std::move(mesh.triangles);
+        this->lengthOfTriangleArray = (unsigned int)this->ownedTriangles.size();
+        this->triangleArray = this->ownedTriangles.data();
+
+        this->hasUserNormals = false;
+        this->hasNormalView = false;
+        this->isPrepared = false;
+    }
+
+    // Borrows a mapped binary mesh, including its precomputed face normals
+    void load(const MappedMesh& mesh) {
+        this->vertexStream.view(mesh.vertexX(), mesh.vertexY(), mesh.vertexZ(), mesh.vertexCount());
+        this->lengthOfVertexArray = mesh.vertexCount();
+
+        this->ownedTriangles.clear();
+        this->lengthOfTriangleArray = 3 * mesh.triangleCount();
+        this->triangleArray = mesh.triangles();
+
+        this->normalStream.view(mesh.normalX(), mesh.normalY(), mesh.normalZ(), mesh.triangleCount());
+        this->lengthOfNormalArray = mesh.triangleCount();
+        this->normalArray = nullptr;
+        this->hasUserNormals = true;
+        this->hasNormalView = true;
+
+        this->isPrepared = false;
+    }
+
+    void prepare(bool isHierarchical, bool isDetailed, bool isSmooth, ThreadPool* pool) {
+        if (this->vertexStream.length() == 0) {
+            throw std::runtime_error("Unintialized Vertex Array: Try using vertex() before rendering");
+        } else if (this->triangleArray == nullptr) {
+            throw std::runtime_error("Unintialized Triangle Array: Try using triangle() before rendering");
+        } else if (this->hasUserNormals && this->lengthOfNormalArray * 3 != this->lengthOfTriangleArray) {
+            throw std::runtime_error("Mismatched Normal Array: Try using normal() again after changing triangles");
+        }
+
+        if (!this->hasUserNormals) {
+            this->lengthOfNormalArray = this->lengthOfTriangleArray / 3;
+            this->normalStream.resize(this->lengthOfNormalArray);
+
+            for (unsigned int i = 0; i < this->lengthOfTriangleArray; i+= 3) {
+                Vec3<float> v0 = this->vertexStream.get(this->triangleArray[i]);
+                Vec3<float> v1 = this->vertexStream.get(this->triangleArray[i + 1]);
+                Vec3<float> v2 = this->vertexStream.get(this->triangleArray[i + 2]);
+
+                Vec3<float> faceNormal = (v1 - v0) ^ (v2 - v1);
+                faceNormal.normalize();
+                this->normalStream.set(i / 3, faceNormal);
+            }
+        } else if (!this->hasNormalView) {
+            this->normalStream.load(this->normalArray, this->lengthOfNormalArray);
+        }
+
+        if (isSmooth) {
+            computeVertexNormals(this->vertexStream, this->triangleArray, this->lengthOfTriangleArray / 3,
+                                 this->normalStream, this->vertexNormalStream);
+        }
+
+        this->boundsMin = Vec3<float>(INFINITY, INFINITY, INFINITY);
+        this->boundsMax = Vec3<float>(-INFINITY, -INFINITY, -INFINITY);
+        for (size_t i = 0; i < this->vertexStream.length(); i++) {
+            Vec3<float> v = this->vertexStream.get(i);
+            this->boundsMin = Vec3<float>(std::min(this->boundsMin.x, v.x), std::min(this->boundsMin.y, v.y), std::min(this->boundsMin.z, v.z));
+            this->boundsMax = Vec3<float>(std::max(this->boundsMax.x, v.x), std::max(this->boundsMax.y, v.y), std::max(this->boundsMax.z, v.z));
+        }
+
+        if (isHierarchical) {
+            this->bvh.build(this->vertexStream, this->triangleArray, this->lengthOfTriangleArray / 3, pool);
+        } else {
+            this->bvh.clear();
+        }
+
+        if (isDetailed) {
+            this->lods.build(this->vertexStream, this->triangleArray, this->lengthOfTriangleArray / 3);
+            if (isSmooth) {
+                for (size_t i = 1; i < this->lods.size(); i++) {
+                    LodChain::Level& level = this->lods.level(i);
+                    computeVertexNormals(level.vertices, level.triangles.data(), level.triangles.size() / 3, level.normals, level.vertexNormals);
+                }
+            }
+        } else {
+            this->lods.clear();
+        }
+
+        this->isPrepared = true;
+    }
+};
+
+// One drawn copy of a model. Instances only refer to their model, so any number of them share its
+// storage and derived data.
+struct Instance {
+    unsigned int model = 0;
+
+    // Applied to the model before the renderer's animated rotation and translation
+    Mat4<float> transform;
+
+    // Orthogonal transforms keep normals unit length; anything else needs the inverse-transpose
+    bool isRigid = true;
+
+    bool isVisible = true;
+
+    // Slot of the renderer's instance colors, used with colorOutput()
+    unsigned char material = 0;
+
+    void place(const Mat4<float>& transform) {
+        this->transform = transform;
+
+        Mat3<float> linear = transform.linear();
+        Mat3<float> gram = linear * linear.transpose();
+        this->isRigid = true;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                if (std::abs(gram.m[r][c] - (r == c ? 1.0f : 0.0f)) > 1e-5f) {
+                    this->isRigid = false;
+                }
+            }
+        }
+    }
+};
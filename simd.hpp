@@ -0,0 +1,351 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include "geometry.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// AVX2 kernels are compiled with a target attribute and only called after a runtime CPU check,
+// so the rest of the program does not need to be built with -mavx2.
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_AVX2 1
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Enough for an AVX register; lengths are padded to this many floats so kernels never need a tail loop
+const size_t SIMD_WIDTH = 8;
+const size_t SIMD_ALIGNMENT = 32;
+
+inline float* allocateAligned(size_t count) {
+    float* data = static_cast<float*>(::operator new(count * sizeof(float), std::align_val_t(SIMD_ALIGNMENT)));
+    std::memset(data, 0, count * sizeof(float));
+    return data;
+}
+
+inline void freeAligned(float* data) {
+    if (data != nullptr) {
+        ::operator delete(data, std::align_val_t(SIMD_ALIGNMENT));
+    }
+}
+
+inline size_t paddedLength(size_t length) {
+    return (length + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+}
+
+// Structure-of-arrays vertex store: x, y and z live in separate aligned, padded float arrays.
+// It either owns its storage or is a read-only view of arrays owned elsewhere, e.g. a mapped file.
+class SoAVertexBuffer {
+public:
+    float* x = nullptr;
+    float* y = nullptr;
+    float* z = nullptr;
+
+    SoAVertexBuffer() {}
+
+    SoAVertexBuffer(const SoAVertexBuffer&) = delete;
+    SoAVertexBuffer& operator=(const SoAVertexBuffer&) = delete;
+
+    ~SoAVertexBuffer() {
+        release();
+    }
+
+    // x, y and z must be SIMD_ALIGNMENT aligned and readable up to paddedLength(length) floats,
+    // and outlive the view. Views are only ever read.
+    void view(const float* x, const float* y, const float* z, size_t length) {
+        if (((uintptr_t)x | (uintptr_t)y | (uintptr_t)z) % SIMD_ALIGNMENT != 0) {
+            throw std::invalid_argument("SoAVertexBuffer View Error: Arrays are not aligned!");
+        }
+
+        release();
+        this->x = const_cast<float*>(x);
+        this->y = const_cast<float*>(y);
+        this->z = const_cast<float*>(z);
+        this->count = length;
+        this->isBorrowed = true;
+    }
+
+    bool isView() const {
+        return this->isBorrowed;
+    }
+
+    size_t length() const {
+        return this->count;
+    }
+
+    size_t padded() const {
+        return paddedLength(this->count);
+    }
+
+    // Keeps the existing storage when it is already large enough
+    void resize(size_t length) {
+        size_t padded = paddedLength(length);
+        if (this->isBorrowed || padded > this->capacity) {
+            release();
+            this->x = allocateAligned(3 * padded);
+            this->capacity = padded;
+        }
+        this->y = this->x + this->capacity;
+        this->z = this->y + this->capacity;
+        this->count = length;
+    }
+
+    void load(const Vec3<float>* vertexArray, size_t length) {
+        resize(length);
+        for (size_t i = 0; i < length; i++) {
+            this->x[i] = vertexArray[i].x;
+            this->y[i] = vertexArray[i].y;
+            this->z[i] = vertexArray[i].z;
+        }
+        for (size_t i = length; i < padded(); i++) {
+            this->x[i] = this->y[i] = this->z[i] = 0;
+        }
+    }
+
+    Vec3<float> get(size_t i) const {
+        return Vec3<float>(this->x[i], this->y[i], this->z[i]);
+    }
+
+    void set(size_t i, const Vec3<float>& v) {
+        this->x[i] = v.x;
+        this->y[i] = v.y;
+        this->z[i] = v.z;
+    }
+
+private:
+    size_t count = 0;
+    size_t capacity = 0;
+    bool isBorrowed = false;
+
+    void release() {
+        if (!this->isBorrowed) {
+            freeAligned(this->x);
+        }
+        this->x = this->y = this->z = nullptr;
+        this->count = 0;
+        this->capacity = 0;
+        this->isBorrowed = false;
+    }
+};
+
+// --- Kernels ---
+// Every kernel processes in.padded() elements. The SIMD kernels use the same operation order
+// as the scalar ones and no fused multiply-add, so all kernel sets produce identical results.
+
+enum class VertexKernelSet {
+    Auto,
+    Scalar,
+    SSE,
+    AVX2
+};
+
+struct VertexKernels {
+    VertexKernelSet set;
+    const char* name;
+
+    // Affine transform: out = M * in
+    void (*transform)(const Mat4<float>& matrix, const SoAVertexBuffer& in, SoAVertexBuffer& out);
+
+    // Projective transform and divide by w; points with w <= 0 are written as (0, 0, 0)
+    void (*project)(const Mat4<float>& matrix, const SoAVertexBuffer& in, SoAVertexBuffer& out);
+
+    // out[i] = in[i] . direction
+    void (*dot)(const SoAVertexBuffer& in, const Vec3<float>& direction, float* out);
+};
+
+inline void transformScalar(const Mat4<float>& matrix, const SoAVertexBuffer& in, SoAVertexBuffer& out) {
+    const float (*m)[4] = matrix.m;
+    for (size_t i = 0; i < in.padded(); i++) {
+        float x = in.x[i], y = in.y[i], z = in.z[i];
+        out.x[i] = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+        out.y[i] = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+        out.z[i] = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+    }
+}
+
+inline void projectScalar(const Mat4<float>& matrix, const SoAVertexBuffer& in, SoAVertexBuffer& out) {
+    const float (*m)[4] = matrix.m;
+    for (size_t i = 0; i < in.padded(); i++) {
+        float x = in.x[i], y = in.y[i], z = in.z[i];
+        float w = m[3][0] * x + m[3][1] * y + m[3][2] * z + m[3][3];
+        if (w > 0) {
+            float invW = 1 / w;
+            out.x[i] = (m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3]) * invW;
+            out.y[i] = (m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3]) * invW;
+            out.z[i] = (m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3]) * invW;
+        } else {
+            out.x[i] = out.y[i] = out.z[i] = 0;
+        }
+    }
+}
+
+inline void dotScalar(const SoAVertexBuffer& in, const Vec3<float>& direction, float* out) {
+    for (size_t i = 0; i < in.padded(); i++) {
+        out[i] = in.x[i] * direction.x + in.y[i] * direction.y + in.z[i] * direction.z;
+    }
+}
+
+#ifdef SIMD_X86
+
+inline void transformSSE(const Mat4<float>& matrix, const SoAVertexBuffer& in, SoAVertexBuffer& out) {
+    __m128 m[3][4];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = _mm_set1_ps(matrix.m[r][c]);
+        }
+    }
+
+    for (size_t i = 0; i < in.padded(); i += 4) {
+        __m128 x = _mm_load_ps(in.x + i), y = _mm_load_ps(in.y + i), z = _mm_load_ps(in.z + i);
+        float* outs[3] = { out.x, out.y, out.z };
+        for (int r = 0; r < 3; r++) {
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r][0], x), _mm_mul_ps(m[r][1], y)), _mm_mul_ps(m[r][2], z)), m[r][3]);
+            _mm_store_ps(outs[r] + i, v);
+        }
+    }
+}
+
+inline void projectSSE(const Mat4<float>& matrix, const SoAVertexBuffer& in, SoAVertexBuffer& out) {
+    __m128 m[4][4];
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = _mm_set1_ps(matrix.m[r][c]);
+        }
+    }
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (size_t i = 0; i < in.padded(); i += 4) {
+        __m128 x = _mm_load_ps(in.x + i), y = _mm_load_ps(in.y + i), z = _mm_load_ps(in.z + i);
+        __m128 w = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3][0], x), _mm_mul_ps(m[3][1], y)), _mm_mul_ps(m[3][2], z)), m[3][3]);
+        __m128 visible = _mm_cmpgt_ps(w, zero);
+        __m128 invW = _mm_div_ps(one, w);
+
+        float* outs[3] = { out.x, out.y, out.z };
+        for (int r = 0; r < 3; r++) {
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r][0], x), _mm_mul_ps(m[r][1], y)), _mm_mul_ps(m[r][2], z)), m[r][3]);
+            _mm_store_ps(outs[r] + i, _mm_and_ps(visible, _mm_mul_ps(v, invW)));
+        }
+    }
+}
+
+inline void dotSSE(const SoAVertexBuffer& in, const Vec3<float>& direction, float* out) {
+    const __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+    for (size_t i = 0; i < in.padded(); i += 4) {
+        __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(in.x + i), dx), _mm_mul_ps(_mm_load_ps(in.y + i), dy)),
+                              _mm_mul_ps(_mm_load_ps(in.z + i), dz));
+        _mm_store_ps(out + i, v);
+    }
+}
+
+#endif
+
+#ifdef SIMD_AVX2
+
+SIMD_TARGET_AVX2 inline void transformAVX2(const Mat4<float>& matrix, const SoAVertexBuffer& in, SoAVertexBuffer& out) {
+    __m256 m[3][4];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = _mm256_set1_ps(matrix.m[r][c]);
+        }
+    }
+
+    for (size_t i = 0; i < in.padded(); i += 8) {
+        __m256 x = _mm256_load_ps(in.x + i), y = _mm256_load_ps(in.y + i), z = _mm256_load_ps(in.z + i);
+        float* outs[3] = { out.x, out.y, out.z };
+        for (int r = 0; r < 3; r++) {
+            __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[r][0], x), _mm256_mul_ps(m[r][1], y)), _mm256_mul_ps(m[r][2], z)), m[r][3]);
+            _mm256_store_ps(outs[r] + i, v);
+        }
+    }
+}
+
+SIMD_TARGET_AVX2 inline void projectAVX2(const Mat4<float>& matrix, const SoAVertexBuffer& in, SoAVertexBuffer& out) {
+    __m256 m[4][4];
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = _mm256_set1_ps(matrix.m[r][c]);
+        }
+    }
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (size_t i = 0; i < in.padded(); i += 8) {
+        __m256 x = _mm256_load_ps(in.x + i), y = _mm256_load_ps(in.y + i), z = _mm256_load_ps(in.z + i);
+        __m256 w = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[3][0], x), _mm256_mul_ps(m[3][1], y)), _mm256_mul_ps(m[3][2], z)), m[3][3]);
+        __m256 visible = _mm256_cmp_ps(w, zero, _CMP_GT_OQ);
+        __m256 invW = _mm256_div_ps(one, w);
+
+        float* outs[3] = { out.x, out.y, out.z };
+        for (int r = 0; r < 3; r++) {
+            __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[r][0], x), _mm256_mul_ps(m[r][1], y)), _mm256_mul_ps(m[r][2], z)), m[r][3]);
+            _mm256_store_ps(outs[r] + i, _mm256_and_ps(visible, _mm256_mul_ps(v, invW)));
+        }
+    }
+}
+
+SIMD_TARGET_AVX2 inline void dotAVX2(const SoAVertexBuffer& in, const Vec3<float>& direction, float* out) {
+    const __m256 dx = _mm256_set1_ps(direction.x), dy = _mm256_set1_ps(direction.y), dz = _mm256_set1_ps(direction.z);
+    for (size_t i = 0; i < in.padded(); i += 8) {
+        __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(in.x + i), dx), _mm256_mul_ps(_mm256_load_ps(in.y + i), dy)),
+                                 _mm256_mul_ps(_mm256_load_ps(in.z + i), dz));
+        _mm256_store_ps(out + i, v);
+    }
+}
+
+#endif
+
+inline bool cpuSupports(VertexKernelSet set) {
+    switch (set) {
+        case VertexKernelSet::Auto:
+        case VertexKernelSet::Scalar:
+            return true;
+#ifdef SIMD_X86
+        case VertexKernelSet::SSE:
+            return true;
+#endif
+#ifdef SIMD_AVX2
+        case VertexKernelSet::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+// Auto picks the widest kernel set the running CPU supports
+inline VertexKernels selectVertexKernels(VertexKernelSet set = VertexKernelSet::Auto) {
+    if (set == VertexKernelSet::Auto) {
+        if (cpuSupports(VertexKernelSet::AVX2)) {
+            set = VertexKernelSet::AVX2;
+        } else if (cpuSupports(VertexKernelSet::SSE)) {
+            set = VertexKernelSet::SSE;
+        } else {
+            set = VertexKernelSet::Scalar;
+        }
+    }
+
+    if (!cpuSupports(set)) {
+        throw std::invalid_argument("Vertex Kernel Error: Kernel set not supported on this CPU!");
+    }
+
+    switch (set) {
+#ifdef SIMD_AVX2
+        case VertexKernelSet::AVX2:
+            return { set, "AVX2", transformAVX2, projectAVX2, dotAVX2 };
+#endif
+#ifdef SIMD_X86
+        case VertexKernelSet::SSE:
+            return { set, "SSE", transformSSE, projectSSE, dotSSE };
+#endif
+        default:
+            return { VertexKernelSet::Scalar, "Scalar", transformScalar, projectScalar, dotScalar };
+    }
+}
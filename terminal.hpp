@@ -3,7 +3,19 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <cstdlib>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+// Blocks for duration milliseconds plus half a second; Timeline::progressBar() draws the same bar
+// without blocking
 void loadingBar(int length, int duration) {
     for (int i = 0; i <= length; i++) {
         int percentage = (i * 100) / length;
@@ -33,4 +45,73 @@ void showCursor() {
 
 void setColor(int textColor, int backgroundColor) {
     std::cout << "\033[" << textColor << ";" << backgroundColor << "m";
-}
\ No newline at end of file
+}
+
+#ifndef _WIN32
+// Terminal settings of stdin before isEscapePressed() changed them
+termios& originalTerminal() {
+    static termios settings;
+    return settings;
+}
+
+const int TERMINAL_SIGNALS[] = { SIGINT, SIGTERM, SIGHUP };
+
+// Handlers in place before restoreTerminalOnSignal(), by position in TERMINAL_SIGNALS
+struct sigaction* originalSignalActions() {
+    static struct sigaction actions[sizeof(TERMINAL_SIGNALS) / sizeof(TERMINAL_SIGNALS[0])];
+    return actions;
+}
+
+// Puts stdin back the way it was, then hands the signal to the handler that was there before, so
+// Ctrl+C and kill do not leave the shell without echo. Only async-signal-safe calls.
+void restoreTerminalOnSignal(int signal) {
+    tcsetattr(STDIN_FILENO, TCSANOW, &originalTerminal());
+    for (size_t i = 0; i < sizeof(TERMINAL_SIGNALS) / sizeof(TERMINAL_SIGNALS[0]); i++) {
+        if (TERMINAL_SIGNALS[i] == signal) {
+            sigaction(signal, &originalSignalActions()[i], nullptr);
+        }
+    }
+    raise(signal);
+}
+#endif
+
+// True when Escape was pressed since the last call. On POSIX terminals the first call turns off
+// line buffering and echo on stdin, so keys arrive without Enter; the settings are restored at exit
+// and on SIGINT, SIGTERM and SIGHUP. An ESC followed by more bytes in the same read starts the
+// sequence of another key, such as an arrow, and is not a press.
+bool isEscapePressed() {
+#ifdef _WIN32
+    return GetAsyncKeyState(VK_ESCAPE) != 0;
+#else
+    static bool isRaw = false;
+    if (!isRaw && isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &originalTerminal()) == 0) {
+        termios raw = originalTerminal();
+        raw.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        std::atexit([] { tcsetattr(STDIN_FILENO, TCSANOW, &originalTerminal()); });
+        for (size_t i = 0; i < sizeof(TERMINAL_SIGNALS) / sizeof(TERMINAL_SIGNALS[0]); i++) {
+            struct sigaction action = {};
+            action.sa_handler = restoreTerminalOnSignal;
+            sigemptyset(&action.sa_mask);
+            sigaction(TERMINAL_SIGNALS[i], nullptr, &originalSignalActions()[i]);
+            if (originalSignalActions()[i].sa_handler != SIG_IGN) {
+                sigaction(TERMINAL_SIGNALS[i], &action, nullptr);
+            }
+        }
+        isRaw = true;
+    }
+
+    bool isPressed = false;
+    bool isEscapePending = false;
+    pollfd input = { STDIN_FILENO, POLLIN, 0 };
+    char keys[64];
+    ssize_t count;
+    while (poll(&input, 1, 0) > 0 && (input.revents & POLLIN) && (count = read(STDIN_FILENO, keys, sizeof(keys))) > 0) {
+        for (ssize_t i = 0; i < count; i++) {
+            isPressed = isPressed || (isEscapePending && keys[i] == 27);
+            isEscapePending = keys[i] == 27;
+        }
+    }
+    return isPressed || isEscapePending;
+#endif
+}
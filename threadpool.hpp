@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Persistent workers that sleep between batches. run() hands out job indices through an atomic
+// counter, works on the batch from the calling thread as well, and returns once every job is done.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    const std::function<void(size_t, unsigned int)>* task = nullptr;
+    size_t jobCount = 0;
+    std::atomic<size_t> nextJob{0};
+
+    unsigned long long generation = 0;
+    unsigned int busyWorkers = 0;
+    bool isStopping = false;
+
+public:
+    // threadCount includes the calling thread, so ThreadPool(1) starts no workers
+    explicit ThreadPool(unsigned int threadCount) {
+        if (threadCount == 0) {
+            throw std::invalid_argument("ThreadPool Constructor Error: Invalid thread count!");
+        }
+
+        for (unsigned int i = 1; i < threadCount; i++) {
+            this->workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->isStopping = true;
+        }
+        this->wakeCondition.notify_all();
+
+        for (std::thread& worker : this->workers) {
+            worker.join();
+        }
+    }
+
+    unsigned int size() const {
+        return (unsigned int)this->workers.size() + 1;
+    }
+
+    // Calls job(index, worker) for every index in [0, jobCount); worker is in [0, size())
+    void run(size_t jobCount, const std::function<void(size_t, unsigned int)>& job) {
+        if (jobCount == 0) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->task = &job;
+            this->jobCount = jobCount;
+            this->nextJob.store(0);
+            this->busyWorkers = (unsigned int)this->workers.size();
+            this->generation++;
+        }
+        this->wakeCondition.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->doneCondition.wait(lock, [this] { return this->busyWorkers == 0; });
+        this->task = nullptr;
+    }
+
+private:
+    void work(unsigned int worker) {
+        for (size_t job = this->nextJob.fetch_add(1); job < this->jobCount; job = this->nextJob.fetch_add(1)) {
+            (*this->task)(job, worker);
+        }
+    }
+
+    void workerLoop(unsigned int worker) {
+        unsigned long long seenGeneration = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wakeCondition.wait(lock, [&] { return this->isStopping || this->generation != seenGeneration; });
+                if (this->isStopping) {
+                    return;
+                }
+                seenGeneration = this->generation;
+            }
+
+            work(worker);
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (--this->busyWorkers == 0) {
+                this->doneCondition.notify_one();
+            }
+        }
+    }
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+// Timed text, progress bars and one-shot events on one steady clock. Nothing here sleeps: the render
+// loop calls advance() once per frame, which fires the events that came due, and draw() puts what is
+// visible at that moment over the frame, e.g. from Renderer::overlay(). Times are in seconds since
+// start(), or since the first advance().
+class Timeline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    // Revealed one character every charDelay seconds, the first at start, and shown until end
+    struct Text {
+        double start, end;
+        int x, y;
+        std::string text;
+        double charDelay;
+        uint32_t rgb;
+    };
+
+    // Fills over duration seconds, then reads " Done!" until end
+    struct Bar {
+        double start, duration, end;
+        int x, y;
+        unsigned int length;
+        uint32_t rgb;
+    };
+
+    struct Event {
+        double time;
+        std::function<void()> action;
+    };
+
+    std::vector<Text> texts;
+    std::vector<Bar> bars;
+
+    // By time, those before nextEvent already fired
+    std::vector<Event> events;
+    size_t nextEvent = 0;
+
+    bool isStarted = false;
+    Clock::time_point startTime;
+    double now = 0;
+    double endTime = 0;
+
+    // Scratch line for bars, sized once they are added
+    std::string line;
+
+public:
+    void start() {
+        this->isStarted = true;
+        this->startTime = Clock::now();
+        this->now = 0;
+    }
+
+    // Moves to the current time and fires every event due by then, in order
+    double advance() {
+        if (!this->isStarted) {
+            start();
+        }
+        return seek(std::chrono::duration<double>(Clock::now() - this->startTime).count());
+    }
+
+    // As advance(), at a given time instead of the clock's, e.g. for headless rendering
+    double seek(double seconds) {
+        this->now = seconds;
+        while (this->nextEvent < this->events.size() && this->events[this->nextEvent].time <= seconds) {
+            // The action may add events, so it is moved out before running
+            std::function<void()> action = std::move(this->events[this->nextEvent++].action);
+            action();
+        }
+        return this->now;
+    }
+
+    double elapsedSeconds() const {
+        return this->now;
+    }
+
+    // End of the last text, bar or event
+    double duration() const {
+        return this->endTime;
+    }
+
+    bool finished() const {
+        return this->now >= this->endTime && this->nextEvent == this->events.size();
+    }
+
+    // Shows text at column x of row y from start to end, revealing one more character every
+    // charDelay seconds. The rgb color only shows with Renderer::colorOutput().
+    void text(double start, double end, int x, int y, const std::string& text, double charDelay = 0, uint32_t rgb = TEXT_COLOR) {
+        if (end < start || charDelay < 0) {
+            throw std::invalid_argument("Timeline Text Error: Invalid times!");
+        }
+        this->texts.push_back(Text{ start, end, x, y, text, charDelay, rgb });
+        this->endTime = std::max(this->endTime, end);
+    }
+
+    // Shows a bar of length cells filling from start to start + duration, with its percentage
+    // behind it, and keeps it until end
+    void progressBar(double start, double duration, double end, int x, int y, unsigned int length, uint32_t rgb = TEXT_COLOR) {
+        if (length == 0) {
+            throw std::invalid_argument("Timeline Bar Error: Invalid length!");
+        }
+        if (duration < 0 || end < start + duration) {
+            throw std::invalid_argument("Timeline Bar Error: Invalid times!");
+        }
+        this->bars.push_back(Bar{ start, duration, end, x, y, length, rgb });
+        this->line.reserve(std::max<size_t>(this->line.capacity(), length + 16));
+        this->endTime = std::max(this->endTime, end);
+    }
+
+    // Runs action from the first advance() at or after time; events at the same time run in the
+    // order they were added
+    void at(double time, std::function<void()> action) {
+        auto position = std::upper_bound(this->events.begin() + this->nextEvent, this->events.end(), time,
+                                         [](double time, const Event& event) { return time < event.time; });
+        this->events.insert(position, Event{ time, std::move(action) });
+        this->endTime = std::max(this->endTime, time);
+    }
+
+    // Draws everything visible at elapsedSeconds() over the renderer's frame
+    void draw(Renderer& renderer) {
+        for (const Text& text : this->texts) {
+            if (this->now < text.start || this->now >= text.end) {
+                continue;
+            }
+            size_t shown = text.text.size();
+            if (text.charDelay > 0) {
+                shown = std::min(shown, (size_t)((this->now - text.start) / text.charDelay) + 1);
+            }
+            renderer.drawText(text.x, text.y, text.text.data(), shown, text.rgb);
+        }
+
+        for (const Bar& bar : this->bars) {
+            if (this->now < bar.start || this->now >= bar.end) {
+                continue;
+            }
+            unsigned int filled = bar.length;
+            if (this->now < bar.start + bar.duration) {
+                filled = std::min(bar.length, (unsigned int)((this->now - bar.start) / bar.duration * bar.length));
+            }
+
+            this->line.assign(1, '{');
+            this->line.append(filled, '=');
+            this->line.append(bar.length - filled, ' ');
+            char percentage[16];
+            std::snprintf(percentage, sizeof(percentage), "} %u%%", filled * 100 / bar.length);
+            this->line.append(percentage);
+            if (filled == bar.length) {
+                this->line.append(" Done!");
+            }
+            renderer.drawText(bar.x, bar.y, this->line.data(), this->line.size(), bar.rgb);
+        }
+    }
+};